@@ -0,0 +1,273 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Measures the activator itself against the mock Controller, so that changes to the activation
+ * engine, the retry policies and the transport can be compared without a device.
+ *
+ * Each repetition starts a fresh MockController, activates a set of plugins through the activation
+ * engine over COM-RPC and reports:
+ *  - wall:         Time to activate every plugin
+ *  - plugin:       Time from first attempt to activated, per plugin
+ *  - round trips:  Activate calls made, from the activator's trace and the mock's own count
+ *  - retry wait:   Time spent waiting between attempts
+ */
+
+#include "Module.h"
+
+#include "ActivationEngine.h"
+#include "ActivationTrace.h"
+#include "BenchmarkStats.h"
+#include "COMRPCStarter.h"
+#include "Log.h"
+#include "MockProcess.h"
+
+#include <fstream>
+#include <memory>
+#include <unistd.h>
+
+static int gPlugins = 20;
+static int gRepetitions = 5;
+static uint8_t gJobs = 1;
+static uint32_t gLatencyMs = 10;
+static string gFailureRate = "0";
+static uint32_t gPreconditionDelayMs = 0;
+static RetryPolicy::Backoff gBackoff = RetryPolicy::Backoff::Fixed;
+static int gRetryCount = 10;
+static int gRetryDelayMs = 100;
+
+static void displayUsage()
+{
+    printf("Usage: ActivationBenchmark <option(s)>\n");
+    printf("    Benchmark the activator against a mock Thunder Controller\n\n");
+    printf("    -h, --help                  Print this help and exit\n");
+    printf("    -n, --plugins               Number of plugins to activate (default 20)\n");
+    printf("    -i, --repetitions           Number of runs, each against a fresh mock (default 5)\n");
+    printf("    -j, --jobs                  Maximum number of plugins activated in parallel (default 1)\n");
+    printf("    -l, --latency               Activation latency of each plugin in ms (default 10)\n");
+    printf("    -f, --failure-rate          Probability (0-1) an activation fails (default 0)\n");
+    printf("    -p, --precondition-delay    Time in ms until the plugins' preconditions are met (default 0)\n");
+    printf("    -b, --backoff               Retry backoff strategy: fixed, exponential or jitter (default fixed)\n");
+    printf("    -r, --retries               Maximum attempts per plugin (default 10)\n");
+    printf("    -d, --delay                 Delay between attempts in ms (default 100)\n");
+}
+
+static void parseArgs(const int argc, char** argv)
+{
+    struct option longopts[] = {
+        { "help", no_argument, nullptr, (int)'h' },
+        { "plugins", required_argument, nullptr, (int)'n' },
+        { "repetitions", required_argument, nullptr, (int)'i' },
+        { "jobs", required_argument, nullptr, (int)'j' },
+        { "latency", required_argument, nullptr, (int)'l' },
+        { "failure-rate", required_argument, nullptr, (int)'f' },
+        { "precondition-delay", required_argument, nullptr, (int)'p' },
+        { "backoff", required_argument, nullptr, (int)'b' },
+        { "retries", required_argument, nullptr, (int)'r' },
+        { "delay", required_argument, nullptr, (int)'d' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int option;
+    int longindex;
+
+    while ((option = getopt_long(argc, argv, "hn:i:j:l:f:p:b:r:d:", longopts, &longindex)) != -1) {
+        switch (option) {
+        case 'h':
+            displayUsage();
+            exit(EXIT_SUCCESS);
+            break;
+        case 'n':
+            gPlugins = std::atoi(optarg);
+            if (gPlugins < 1) {
+                fprintf(stderr, "Error: Number of plugins must be > 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'i':
+            gRepetitions = std::atoi(optarg);
+            if (gRepetitions < 1) {
+                fprintf(stderr, "Error: Repetitions must be > 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j': {
+            const int jobs = std::atoi(optarg);
+            if (jobs < 1 || jobs > 255) {
+                fprintf(stderr, "Error: Jobs must be between 1 and 255\n");
+                exit(EXIT_FAILURE);
+            }
+            gJobs = static_cast<uint8_t>(jobs);
+            break;
+        }
+        case 'l':
+            gLatencyMs = std::atoi(optarg);
+            break;
+        case 'f':
+            gFailureRate = optarg;
+            break;
+        case 'p':
+            gPreconditionDelayMs = std::atoi(optarg);
+            break;
+        case 'b':
+            if (!RetryPolicy::parseBackoff(optarg, gBackoff)) {
+                fprintf(stderr, "Error: Unknown backoff strategy '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r':
+            gRetryCount = std::atoi(optarg);
+            if (gRetryCount < 1) {
+                fprintf(stderr, "Error: Retries must be > 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'd':
+            gRetryDelayMs = std::atoi(optarg);
+            if (gRetryDelayMs < 0) {
+                fprintf(stderr, "Error: Delay must be >= 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            displayUsage();
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+}
+
+struct RunStats {
+    BenchmarkStats plugin;
+    uint32_t roundTrips;
+    uint64_t retryWaitUs;
+};
+
+/**
+ * @brief Pull the per-phase timings for one run out of the activator's JSON lines trace
+ */
+static void readTrace(const std::string& path, RunStats& stats)
+{
+    std::ifstream trace(path);
+    std::string line;
+
+    while (std::getline(trace, line)) {
+        char phase[32];
+        unsigned long long durationUs = 0;
+
+        if (sscanf(line.c_str(), "{\"phase\":\"%31[^\"]\"", phase) != 1) {
+            continue;
+        }
+
+        const size_t duration = line.find("\"duration_us\":");
+        if (duration == std::string::npos || sscanf(line.c_str() + duration, "\"duration_us\":%llu", &durationUs) != 1) {
+            continue;
+        }
+
+        if (strcmp(phase, "plugin") == 0) {
+            stats.plugin.add(durationUs);
+        } else if (strcmp(phase, "activate") == 0) {
+            stats.roundTrips++;
+        } else if (strcmp(phase, "retry-wait") == 0) {
+            stats.retryWaitUs += durationUs;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    parseArgs(argc, argv);
+
+    // Keep logging off the measured path
+    initLogging(LEVEL_ERROR);
+
+    const std::string socketPath = "/tmp/ActivationBenchmark." + std::to_string(getpid());
+    const std::string tracePath = socketPath + ".trace";
+
+    // The starters find the controller through the same variable Thunder uses
+    setenv("COMMUNICATOR_PATH", socketPath.c_str(), 1);
+
+    const std::vector<std::string> mockArguments = {
+        "--latency", std::to_string(gLatencyMs),
+        "--failure-rate", gFailureRate,
+        "--precondition-delay", std::to_string(gPreconditionDelayMs)
+    };
+
+    const RetryPolicy policy(gBackoff, gRetryCount, gRetryDelayMs, gRetryDelayMs * 16, 0);
+
+    BenchmarkStats wall;
+    BenchmarkStats plugin;
+    BenchmarkStats roundTrips;
+    BenchmarkStats retryWait;
+    uint32_t failed = 0;
+    bool success = true;
+
+    for (int run = 0; run < gRepetitions && success; run++) {
+        MockProcess mock;
+        if (!mock.start(socketPath, mockArguments)) {
+            fprintf(stderr, "Error: Failed to start MockController\n");
+            success = false;
+            break;
+        }
+
+        unlink(tracePath.c_str());
+        ActivationTrace::instance().open(tracePath, ActivationTrace::Format::Json);
+
+        ActivationEngine engine([]() { return std::unique_ptr<IPluginStarter>(new COMRPCStarter()); }, gJobs);
+        for (int i = 0; i < gPlugins; i++) {
+            engine.addPlugin("Plugin" + std::to_string(i));
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        engine.run(policy);
+        wall.add(elapsedUs(start));
+
+        for (const auto& result : engine.results()) {
+            if (result.outcome != ActivationEngine::Outcome::Succeeded) {
+                failed++;
+            }
+        }
+
+        ActivationTrace::instance().flush();
+
+        RunStats stats = { BenchmarkStats(), 0, 0 };
+        readTrace(tracePath, stats);
+        plugin.add(stats.plugin);
+        roundTrips.add(stats.roundTrips);
+        retryWait.add(stats.retryWaitUs);
+
+        printf("run %d: mock %s\n", run + 1, mock.stop().c_str());
+    }
+
+    unlink(tracePath.c_str());
+
+    if (success) {
+        printf("\n%d plugins, %d runs, %u jobs, %ums latency, failure rate %s, precondition delay %ums, %s backoff (%u failed)\n",
+            gPlugins, gRepetitions, gJobs, gLatencyMs, gFailureRate.c_str(), gPreconditionDelayMs, RetryPolicy::backoffName(gBackoff), failed);
+        BenchmarkStats::printHeader();
+        wall.print("wall (per run)");
+        plugin.print("plugin (per plugin)");
+        retryWait.print("retry wait (per run)");
+        printf("round trips: %llu per run, %.2f per plugin\n", static_cast<unsigned long long>(roundTrips.mean()),
+            static_cast<double>(roundTrips.mean()) / gPlugins);
+    }
+
+    Core::Singleton::Dispose();
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,90 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+/**
+ * @brief Collects latency samples (in microseconds) and reports their distribution
+ */
+class BenchmarkStats {
+public:
+    BenchmarkStats() = default;
+    ~BenchmarkStats() = default;
+
+    void add(const uint64_t sampleUs) { _samples.push_back(sampleUs); }
+    void add(const BenchmarkStats& other) { _samples.insert(_samples.end(), other._samples.begin(), other._samples.end()); }
+
+    size_t count() const { return _samples.size(); }
+
+    uint64_t percentile(const double percent) const
+    {
+        if (_samples.empty()) {
+            return 0;
+        }
+
+        std::vector<uint64_t> sorted(_samples);
+        std::sort(sorted.begin(), sorted.end());
+
+        const size_t index = static_cast<size_t>((percent / 100.0) * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    uint64_t mean() const
+    {
+        if (_samples.empty()) {
+            return 0;
+        }
+
+        uint64_t total = 0;
+        for (uint64_t sample : _samples) {
+            total += sample;
+        }
+        return total / _samples.size();
+    }
+
+    static void printHeader()
+    {
+        printf("%-28s %8s %10s %10s %10s %10s %10s %10s\n", "", "samples", "min(us)", "mean(us)", "p50(us)", "p95(us)", "p99(us)", "max(us)");
+    }
+
+    void print(const char* name) const
+    {
+        printf("%-28s %8zu %10llu %10llu %10llu %10llu %10llu %10llu\n", name, count(),
+            static_cast<unsigned long long>(percentile(0)), static_cast<unsigned long long>(mean()),
+            static_cast<unsigned long long>(percentile(50)), static_cast<unsigned long long>(percentile(95)),
+            static_cast<unsigned long long>(percentile(99)), static_cast<unsigned long long>(percentile(100)));
+    }
+
+private:
+    std::vector<uint64_t> _samples;
+};
+
+/**
+ * @brief Microseconds elapsed since the given time point
+ */
+inline uint64_t elapsedUs(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
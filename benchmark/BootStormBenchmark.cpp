@@ -0,0 +1,395 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Measures how activation behaves when many activators start at once, as they do when systemd starts
+ * a unit per plugin during boot.
+ *
+ * For each activator count, every repetition starts a fresh MockController, spawns that many
+ * PluginActivator processes back to back - each activating its own plugin(s) - and waits for all of
+ * them to exit. Reported per activator count:
+ *  - makespan:         From spawning the first activator to the last one exiting
+ *  - activator:        From spawning an activator to it exiting, per activator
+ *  - plugin:           Time from first attempt to activated, per plugin, from the activators' traces
+ *  - conn failures:    Failed attempts to open the controller connection
+ *  - retries:          Waits between attempts
+ *  - failed:           Activators that exited with an error
+ *
+ * Anything after "--" is passed to every activator, to compare retry or connection settings
+ */
+
+#include "Module.h"
+
+#include "BenchmarkStats.h"
+#include "MockProcess.h"
+
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static std::vector<int> gActivatorCounts = { 1, 2, 4, 8, 16, 32, 64 };
+static int gPluginsPerActivator = 1;
+static int gRepetitions = 3;
+static uint32_t gLatencyMs = 10;
+static uint32_t gMaxLatencyMs = 0;
+static std::string gFailureRate = "0";
+static uint32_t gPreconditionDelayMs = 0;
+static std::string gActivator;
+static std::vector<std::string> gActivatorArguments;
+
+static void displayUsage()
+{
+    printf("Usage: BootStormBenchmark <option(s)> [-- <activator option(s)>]\n");
+    printf("    Benchmark many activators starting at once against a mock Thunder Controller\n\n");
+    printf("    -h, --help                  Print this help and exit\n");
+    printf("    -N, --activators            Comma separated numbers of concurrent activators to run\n");
+    printf("                                (default 1,2,4,8,16,32,64)\n");
+    printf("    -n, --plugins               Number of plugins each activator activates (default 1)\n");
+    printf("    -i, --repetitions           Number of runs per activator count, each against a fresh mock (default 3)\n");
+    printf("    -l, --latency               Activation latency of each plugin in ms (default 10)\n");
+    printf("    -L, --max-latency           Spread the plugins' latencies evenly between --latency and this (in ms)\n");
+    printf("    -f, --failure-rate          Probability (0-1) an activation fails (default 0)\n");
+    printf("    -p, --precondition-delay    Time in ms until the plugins' preconditions are met (default 0)\n");
+    printf("    -a, --activator             Path of the PluginActivator executable (default ../PluginActivator)\n");
+}
+
+/**
+ * @brief Parse a comma separated list of activator counts
+ *
+ * @return False if the list is empty or has a count below 1
+ */
+static bool parseCounts(const char* argument)
+{
+    std::istringstream values(argument);
+    std::string value;
+
+    gActivatorCounts.clear();
+    while (std::getline(values, value, ',')) {
+        const int count = std::atoi(value.c_str());
+        if (count < 1) {
+            return false;
+        }
+        gActivatorCounts.push_back(count);
+    }
+
+    return !gActivatorCounts.empty();
+}
+
+static void parseArgs(const int argc, char** argv)
+{
+    struct option longopts[] = {
+        { "help", no_argument, nullptr, (int)'h' },
+        { "activators", required_argument, nullptr, (int)'N' },
+        { "plugins", required_argument, nullptr, (int)'n' },
+        { "repetitions", required_argument, nullptr, (int)'i' },
+        { "latency", required_argument, nullptr, (int)'l' },
+        { "max-latency", required_argument, nullptr, (int)'L' },
+        { "failure-rate", required_argument, nullptr, (int)'f' },
+        { "precondition-delay", required_argument, nullptr, (int)'p' },
+        { "activator", required_argument, nullptr, (int)'a' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int option;
+    int longindex;
+
+    while ((option = getopt_long(argc, argv, "hN:n:i:l:L:f:p:a:", longopts, &longindex)) != -1) {
+        switch (option) {
+        case 'h':
+            displayUsage();
+            exit(EXIT_SUCCESS);
+            break;
+        case 'N':
+            if (!parseCounts(optarg)) {
+                fprintf(stderr, "Error: Activator counts must be a comma separated list of numbers > 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'n':
+            gPluginsPerActivator = std::atoi(optarg);
+            if (gPluginsPerActivator < 1) {
+                fprintf(stderr, "Error: Number of plugins must be > 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'i':
+            gRepetitions = std::atoi(optarg);
+            if (gRepetitions < 1) {
+                fprintf(stderr, "Error: Repetitions must be > 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'l':
+            gLatencyMs = std::atoi(optarg);
+            break;
+        case 'L':
+            gMaxLatencyMs = std::atoi(optarg);
+            break;
+        case 'f':
+            gFailureRate = optarg;
+            break;
+        case 'p':
+            gPreconditionDelayMs = std::atoi(optarg);
+            break;
+        case 'a':
+            gActivator = optarg;
+            break;
+        default:
+            displayUsage();
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    for (int i = optind; i < argc; i++) {
+        gActivatorArguments.push_back(argv[i]);
+    }
+
+    if (gActivator.empty()) {
+        gActivator = MockProcess::siblingExecutable("../PluginActivator");
+    }
+}
+
+static std::string callsign(const int activator, const int plugin)
+{
+    return "Plugin" + std::to_string(activator) + "_" + std::to_string(plugin);
+}
+
+/**
+ * @brief Mock options, giving each plugin its own latency if they are spread
+ */
+static std::vector<std::string> mockArguments(const int activators)
+{
+    std::vector<std::string> arguments = {
+        "--latency", std::to_string(gLatencyMs),
+        "--failure-rate", gFailureRate,
+        "--precondition-delay", std::to_string(gPreconditionDelayMs)
+    };
+
+    const int plugins = activators * gPluginsPerActivator;
+
+    if (gMaxLatencyMs > gLatencyMs && plugins > 1) {
+        for (int i = 0; i < plugins; i++) {
+            const uint32_t latencyMs = gLatencyMs + static_cast<uint32_t>(static_cast<uint64_t>(gMaxLatencyMs - gLatencyMs) * i / (plugins - 1));
+
+            arguments.push_back("--plugin");
+            arguments.push_back(callsign(i / gPluginsPerActivator, i % gPluginsPerActivator) + "=" + std::to_string(latencyMs) + "," + gFailureRate);
+        }
+    }
+
+    return arguments;
+}
+
+/**
+ * @brief Start an activator for its plugins, logging to the trace file and nowhere else
+ *
+ * @return Process id, or -1 if it could not be started
+ */
+static pid_t spawnActivator(const int index, const std::string& tracePath)
+{
+    std::vector<std::string> argv = { gActivator, "--trace", tracePath, "--trace-format", "json" };
+    argv.insert(argv.end(), gActivatorArguments.begin(), gActivatorArguments.end());
+    for (int plugin = 0; plugin < gPluginsPerActivator; plugin++) {
+        argv.push_back(callsign(index, plugin));
+    }
+
+    std::vector<char*> args;
+    for (std::string& argument : argv) {
+        args.push_back(&argument[0]);
+    }
+    args.push_back(nullptr);
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        const int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(gActivator.c_str(), args.data());
+        _exit(127);
+    }
+
+    return pid;
+}
+
+struct StormStats {
+    BenchmarkStats makespan;
+    BenchmarkStats activator;
+    BenchmarkStats plugin;
+    uint32_t connectFailures;
+    uint32_t retries;
+    uint32_t failed;
+};
+
+/**
+ * @brief Pull the plugin timings, connection failures and retries out of the activators' JSON lines trace
+ */
+static void readTrace(const std::string& path, StormStats& stats)
+{
+    std::ifstream trace(path);
+    std::string line;
+
+    while (std::getline(trace, line)) {
+        char phase[32];
+        unsigned long long durationUs = 0;
+        unsigned int result = 0;
+
+        if (sscanf(line.c_str(), "{\"phase\":\"%31[^\"]\"", phase) != 1) {
+            continue;
+        }
+
+        const size_t duration = line.find("\"duration_us\":");
+        const size_t outcome = line.find("\"result\":");
+        if (duration == std::string::npos || outcome == std::string::npos
+            || sscanf(line.c_str() + duration, "\"duration_us\":%llu", &durationUs) != 1
+            || sscanf(line.c_str() + outcome, "\"result\":%u", &result) != 1) {
+            continue;
+        }
+
+        if (strcmp(phase, "plugin") == 0) {
+            stats.plugin.add(durationUs);
+        } else if (strcmp(phase, "open") == 0 && result != 0) {
+            stats.connectFailures++;
+        } else if (strcmp(phase, "retry-wait") == 0) {
+            stats.retries++;
+        }
+    }
+}
+
+/**
+ * @brief Start the activators all at once and wait for every one of them to finish
+ *
+ * @return False if the mock or an activator could not be started, or no plugin activation was traced
+ */
+static bool storm(const int activators, const std::string& socketPath, const std::string& tracePath, StormStats& stats)
+{
+    MockProcess mock;
+    if (!mock.start(socketPath, mockArguments(activators))) {
+        fprintf(stderr, "Error: Failed to start MockController\n");
+        return false;
+    }
+
+    unlink(tracePath.c_str());
+
+    std::map<pid_t, std::chrono::steady_clock::time_point> started;
+    bool success = true;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < activators; i++) {
+        const pid_t pid = spawnActivator(i, tracePath);
+        if (pid < 0) {
+            fprintf(stderr, "Error: Failed to start activator %d (%s)\n", i, strerror(errno));
+            success = false;
+            break;
+        }
+        started[pid] = std::chrono::steady_clock::now();
+    }
+
+    while (!started.empty()) {
+        int status;
+        const pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            break;
+        }
+
+        auto entry = started.find(pid);
+        if (entry == started.end()) {
+            continue;
+        }
+
+        stats.activator.add(elapsedUs(entry->second));
+        started.erase(entry);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            stats.failed++;
+        }
+    }
+
+    stats.makespan.add(elapsedUs(start));
+
+    const size_t samples = stats.plugin.count();
+    readTrace(tracePath, stats);
+    printf("%d activators: mock %s\n", activators, mock.stop().c_str());
+
+    // Activators that never reached the mock (e.g. gave up on discovery) exit without tracing a plugin,
+    // which would otherwise be reported as a very fast storm
+    if (success && stats.plugin.count() == samples) {
+        fprintf(stderr, "Error: No plugin activations were traced, check that %s can reach the mock\n", gActivator.c_str());
+        success = false;
+    }
+
+    return success;
+}
+
+int main(int argc, char* argv[])
+{
+    parseArgs(argc, argv);
+
+    if (access(gActivator.c_str(), X_OK) != 0) {
+        fprintf(stderr, "Error: Cannot run %s, use --activator to give its path\n", gActivator.c_str());
+        return EXIT_FAILURE;
+    }
+
+    const std::string socketPath = "/tmp/BootStormBenchmark." + std::to_string(getpid());
+    const std::string tracePath = socketPath + ".trace";
+
+    // The activators find the controller through the same variable Thunder uses. The mock names its
+    // process Thunder, so their process discovery finds it too
+    setenv("COMMUNICATOR_PATH", socketPath.c_str(), 1);
+
+    std::vector<std::pair<int, StormStats>> results;
+    bool success = true;
+
+    for (int activators : gActivatorCounts) {
+        StormStats stats = { BenchmarkStats(), BenchmarkStats(), BenchmarkStats(), 0, 0, 0 };
+
+        for (int run = 0; run < gRepetitions && success; run++) {
+            success = storm(activators, socketPath, tracePath, stats);
+        }
+        if (!success) {
+            break;
+        }
+
+        results.emplace_back(activators, stats);
+    }
+
+    unlink(tracePath.c_str());
+
+    if (success) {
+        printf("\n%d plugin(s) per activator, %d runs, %u-%ums latency, failure rate %s, precondition delay %ums\n",
+            gPluginsPerActivator, gRepetitions, gLatencyMs, std::max(gLatencyMs, gMaxLatencyMs), gFailureRate.c_str(), gPreconditionDelayMs);
+        printf("%10s %13s %13s %13s %13s %13s %13s %13s %13s %10s\n", "activators", "makespan(ms)", "activator p50", "activator p95",
+            "plugin p50", "plugin p95", "plugin max", "conn failures", "retries", "failed");
+
+        for (const auto& result : results) {
+            const StormStats& stats = result.second;
+            printf("%10d %13.1f %13.1f %13.1f %13.1f %13.1f %13.1f %13.1f %13.1f %10.1f\n", result.first,
+                stats.makespan.percentile(50) / 1000.0, stats.activator.percentile(50) / 1000.0, stats.activator.percentile(95) / 1000.0,
+                stats.plugin.percentile(50) / 1000.0, stats.plugin.percentile(95) / 1000.0, stats.plugin.percentile(100) / 1000.0,
+                static_cast<double>(stats.connectFailures) / gRepetitions, static_cast<double>(stats.retries) / gRepetitions,
+                static_cast<double>(stats.failed) / gRepetitions);
+        }
+        printf("(times in ms, medians over runs; conn failures, retries and failed are per run)\n");
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
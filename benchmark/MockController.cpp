@@ -0,0 +1,406 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MockController.h"
+
+#include "Log.h"
+
+#include <set>
+#include <vector>
+
+MockController::Server::Server(const Core::NodeId& node, MockController& controller)
+    : RPC::Communicator(node, _T(""))
+    , _controller(controller)
+{
+}
+
+/**
+ * @brief Hand out the controller for whatever interface the client asks for
+ *
+ * SmartControllerInterfaceType acquires the controller interfaces with an empty class name
+ */
+void* MockController::Server::Acquire(const string& className VARIABLE_IS_NOT_USED, const uint32_t interfaceId, const uint32_t versionId VARIABLE_IS_NOT_USED)
+{
+    return _controller.QueryInterface(interfaceId);
+}
+
+MockController::MockController(const Behaviour& defaultBehaviour, const uint32_t preconditionDelayMs)
+    : _defaultBehaviour(defaultBehaviour)
+    , _preconditionDelayMs(preconditionDelayMs)
+    , _lock()
+    , _behaviours()
+    , _states()
+    , _lifetimeSinks()
+    , _subsystemSinks()
+    , _random(std::random_device()())
+    , _statistics({ 0, 0, 0, 0, 0 })
+    , _subsystemActive(preconditionDelayMs == 0)
+    , _running(true)
+    , _stopSignal()
+    , _timer()
+{
+    if (!_subsystemActive) {
+        _timer = std::thread(&MockController::subsystemTimer, this);
+    }
+}
+
+MockController::~MockController()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _running = false;
+        _stopSignal.notify_all();
+    }
+
+    if (_timer.joinable()) {
+        _timer.join();
+    }
+
+    for (auto sink : _lifetimeSinks) {
+        sink->Release();
+    }
+    for (auto sink : _subsystemSinks) {
+        sink->Release();
+    }
+}
+
+void MockController::configure(const string& callsign, const Behaviour& behaviour)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _behaviours[callsign] = behaviour;
+}
+
+MockController::Statistics MockController::statistics() const
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    return _statistics;
+}
+
+Core::hresult MockController::Register(ILifeTime::INotification* sink)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    sink->AddRef();
+    _lifetimeSinks.push_back(sink);
+
+    return Core::ERROR_NONE;
+}
+
+Core::hresult MockController::Unregister(ILifeTime::INotification* sink)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    for (auto it = _lifetimeSinks.begin(); it != _lifetimeSinks.end(); ++it) {
+        if (*it == sink) {
+            _lifetimeSinks.erase(it);
+            sink->Release();
+            return Core::ERROR_NONE;
+        }
+    }
+
+    return Core::ERROR_UNKNOWN_KEY;
+}
+
+Core::hresult MockController::Activate(const string& callsign)
+{
+    Behaviour config;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _statistics.calls++;
+
+        auto state = _states.find(callsign);
+        if (state != _states.end()) {
+            switch (state->second) {
+            case PluginHost::IShell::state::ACTIVATED:
+                return Core::ERROR_NONE;
+            case PluginHost::IShell::state::ACTIVATION:
+            case PluginHost::IShell::state::DEACTIVATION:
+                return Core::ERROR_INPROGRESS;
+            default:
+                break;
+            }
+        }
+
+        config = behaviour(callsign);
+
+        if (config.precondition && !_subsystemActive) {
+            _statistics.pending++;
+            _states[callsign] = PluginHost::IShell::state::PRECONDITION;
+            return Core::ERROR_PENDING_CONDITIONS;
+        }
+
+        _states[callsign] = PluginHost::IShell::state::ACTIVATION;
+    }
+
+    return activate(callsign, config);
+}
+
+Core::hresult MockController::Deactivate(const string& callsign)
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _statistics.calls++;
+
+        auto state = _states.find(callsign);
+        if (state == _states.end() || state->second == PluginHost::IShell::state::DEACTIVATED) {
+            return Core::ERROR_NONE;
+        }
+        if (state->second != PluginHost::IShell::state::ACTIVATED && state->second != PluginHost::IShell::state::PRECONDITION) {
+            return Core::ERROR_INPROGRESS;
+        }
+
+        _statistics.deactivations++;
+    }
+
+    changeState(callsign, PluginHost::IShell::state::DEACTIVATED, PluginHost::IShell::reason::REQUESTED);
+    return Core::ERROR_NONE;
+}
+
+Core::hresult MockController::Unavailable(const string& callsign VARIABLE_IS_NOT_USED)
+{
+    return Core::ERROR_NOT_SUPPORTED;
+}
+
+Core::hresult MockController::Hibernate(const string& callsign VARIABLE_IS_NOT_USED, const uint32_t timeout VARIABLE_IS_NOT_USED)
+{
+    return Core::ERROR_NOT_SUPPORTED;
+}
+
+Core::hresult MockController::Suspend(const string& callsign VARIABLE_IS_NOT_USED)
+{
+    return Core::ERROR_NOT_SUPPORTED;
+}
+
+Core::hresult MockController::Resume(const string& callsign VARIABLE_IS_NOT_USED)
+{
+    return Core::ERROR_NOT_SUPPORTED;
+}
+
+Core::hresult MockController::Register(ISubsystems::INotification* sink)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    sink->AddRef();
+    _subsystemSinks.push_back(sink);
+
+    return Core::ERROR_NONE;
+}
+
+Core::hresult MockController::Unregister(ISubsystems::INotification* sink)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    for (auto it = _subsystemSinks.begin(); it != _subsystemSinks.end(); ++it) {
+        if (*it == sink) {
+            _subsystemSinks.erase(it);
+            sink->Release();
+            return Core::ERROR_NONE;
+        }
+    }
+
+    return Core::ERROR_UNKNOWN_KEY;
+}
+
+Core::hresult MockController::Subsystems(ISubsystems::ISubsystemsIterator*& subsystems) const
+{
+    std::list<ISubsystems::Subsystem> list;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        list.push_back({ PluginHost::ISubSystem::subsystem::PLATFORM, _subsystemActive });
+    }
+
+    using Iterator = RPC::IteratorType<ISubsystems::ISubsystemsIterator>;
+    subsystems = Core::ServiceType<Iterator>::Create<ISubsystems::ISubsystemsIterator>(list);
+
+    return Core::ERROR_NONE;
+}
+
+/**
+ * @brief Metadata of one plugin, or of every plugin known to the mock (and the Controller itself) if no callsign is given
+ */
+Core::hresult MockController::Services(const string& callsign, IMetadata::Data::IServicesIterator*& services) const
+{
+    std::list<IMetadata::Data::Service> list;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        if (!callsign.empty()) {
+            list.push_back(service(callsign));
+        } else {
+            IMetadata::Data::Service controller = service(_T("Controller"));
+            controller.State = PluginHost::IShell::state::ACTIVATED;
+            controller.Precondition.clear();
+            list.push_back(controller);
+
+            std::set<string> callsigns;
+            for (const auto& entry : _behaviours) {
+                callsigns.insert(entry.first);
+            }
+            for (const auto& entry : _states) {
+                callsigns.insert(entry.first);
+            }
+            for (const string& name : callsigns) {
+                list.push_back(service(name));
+            }
+        }
+    }
+
+    using Iterator = RPC::IteratorType<IMetadata::Data::IServicesIterator>;
+    services = Core::ServiceType<Iterator>::Create<IMetadata::Data::IServicesIterator>(list);
+
+    return Core::ERROR_NONE;
+}
+
+/**
+ * @brief Behaviour configured for the callsign, or the default. Must be called with the lock held
+ */
+MockController::Behaviour MockController::behaviour(const string& callsign) const
+{
+    auto it = _behaviours.find(callsign);
+    return (it != _behaviours.end()) ? it->second : _defaultBehaviour;
+}
+
+/**
+ * @brief Metadata the mock reports for a plugin, plugins it hasn't seen yet are deactivated. Must be called with the lock held
+ *
+ * Preconditions are written the way Thunder stores them from the plugin configuration, as a JSON array of subsystem names
+ */
+Exchange::Controller::IMetadata::Data::Service MockController::service(const string& callsign) const
+{
+    IMetadata::Data::Service service;
+
+    service.Callsign = callsign;
+    service.Locator = _T("libMock.so");
+    service.ClassName = _T("Mock");
+    service.Module = _T("Mock");
+
+    auto state = _states.find(callsign);
+    service.State = (state != _states.end()) ? state->second : PluginHost::IShell::state::DEACTIVATED;
+
+    if (behaviour(callsign).precondition) {
+        service.Precondition = string(_T("[\"")) + Core::EnumerateType<PluginHost::ISubSystem::subsystem>(PluginHost::ISubSystem::subsystem::PLATFORM).Data() + _T("\"]");
+    }
+
+    return service;
+}
+
+/**
+ * @brief Simulate the plugin initialising, the plugin must already be in the ACTIVATION state
+ */
+uint32_t MockController::activate(const string& callsign, const Behaviour& behaviour)
+{
+    if (behaviour.latencyMs > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(behaviour.latencyMs));
+    }
+
+    bool failed;
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        failed = (std::uniform_real_distribution<double>(0.0, 1.0)(_random) < behaviour.failureRate);
+        if (failed) {
+            _statistics.failures++;
+        } else {
+            _statistics.activations++;
+        }
+    }
+
+    if (failed) {
+        changeState(callsign, PluginHost::IShell::state::DEACTIVATED, PluginHost::IShell::reason::INITIALIZATION_FAILED);
+        return Core::ERROR_GENERAL;
+    }
+
+    changeState(callsign, PluginHost::IShell::state::ACTIVATED, PluginHost::IShell::reason::REQUESTED);
+    return Core::ERROR_NONE;
+}
+
+void MockController::changeState(const string& callsign, const PluginHost::IShell::state state, const PluginHost::IShell::reason reason)
+{
+    std::vector<ILifeTime::INotification*> sinks;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _states[callsign] = state;
+
+        for (auto sink : _lifetimeSinks) {
+            sink->AddRef();
+            sinks.push_back(sink);
+        }
+    }
+
+    // Call out without the lock held, the client may call straight back in
+    for (auto sink : sinks) {
+        sink->StateChange(callsign, state, reason);
+        sink->Release();
+    }
+}
+
+/**
+ * @brief Bring the simulated subsystem up after the configured delay
+ *
+ * Notifies subsystem observers, then activates every plugin that was waiting on it
+ */
+void MockController::subsystemTimer()
+{
+    std::vector<ISubsystems::INotification*> sinks;
+    std::vector<std::pair<string, Behaviour>> waiting;
+
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+
+        if (_stopSignal.wait_for(lock, std::chrono::milliseconds(_preconditionDelayMs), [this]() { return !_running; })) {
+            return;
+        }
+
+        _subsystemActive = true;
+        LOG_INF("Mock", "Subsystem now active after %ums", _preconditionDelayMs);
+
+        for (auto sink : _subsystemSinks) {
+            sink->AddRef();
+            sinks.push_back(sink);
+        }
+
+        for (auto& state : _states) {
+            if (state.second == PluginHost::IShell::state::PRECONDITION) {
+                state.second = PluginHost::IShell::state::ACTIVATION;
+                waiting.emplace_back(state.first, behaviour(state.first));
+            }
+        }
+    }
+
+    if (!sinks.empty()) {
+        ISubsystems::ISubsystemsIterator* subsystems = nullptr;
+        Subsystems(subsystems);
+
+        for (auto sink : sinks) {
+            subsystems->Reset(0);
+            sink->SubsystemChange(subsystems);
+            sink->Release();
+        }
+
+        subsystems->Release();
+    }
+
+    for (auto& plugin : waiting) {
+        activate(plugin.first, plugin.second);
+    }
+}
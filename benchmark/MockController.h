@@ -0,0 +1,139 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "Module.h"
+
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace WPEFramework;
+
+/**
+ * @brief Stand-in for the Thunder Controller, for benchmarking the activator without a device
+ *
+ * Implements the Controller's ILifeTime, ISubsystems and IMetadata interfaces with configurable behaviour per callsign:
+ *  - latencyMs:        How long Activate() blocks for, simulating the plugin's Initialize()
+ *  - failureRate:      Probability (0-1) that an activation fails with ERROR_GENERAL
+ *  - precondition:     Whether the plugin needs the simulated subsystem, which only becomes active
+ *                      preconditionDelayMs after the mock starts. Until then Activate() returns
+ *                      ERROR_PENDING_CONDITIONS and, like Thunder, the plugin is activated automatically
+ *                      once the subsystem comes up
+ *
+ * IMetadata reports the state and preconditions of every plugin the mock knows about, either configured or
+ * seen in a call, so state queries, precondition diagnostics and snapshots can be exercised too
+ *
+ * Served over COM-RPC by MockController::Server, which hands out this object for any interface
+ * requested from the "controller" (empty class name), like the real Thunder does
+ */
+class MockController : public Exchange::Controller::ILifeTime,
+                       public Exchange::Controller::ISubsystems,
+                       public Exchange::Controller::IMetadata {
+public:
+    struct Behaviour {
+        uint32_t latencyMs;
+        double failureRate;
+        bool precondition;
+    };
+
+    struct Statistics {
+        uint32_t calls;
+        uint32_t activations;
+        uint32_t deactivations;
+        uint32_t pending;
+        uint32_t failures;
+    };
+
+    class Server : public RPC::Communicator {
+    public:
+        Server(const Core::NodeId& node, MockController& controller);
+        ~Server() override = default;
+
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+    private:
+        void* Acquire(const string& className, const uint32_t interfaceId, const uint32_t versionId) override;
+
+    private:
+        MockController& _controller;
+    };
+
+public:
+    MockController(const Behaviour& defaultBehaviour, const uint32_t preconditionDelayMs);
+    ~MockController() override;
+
+    MockController(const MockController&) = delete;
+    MockController& operator=(const MockController&) = delete;
+
+    void configure(const string& callsign, const Behaviour& behaviour);
+    Statistics statistics() const;
+
+    // ILifeTime
+    Core::hresult Register(ILifeTime::INotification* sink) override;
+    Core::hresult Unregister(ILifeTime::INotification* sink) override;
+    Core::hresult Activate(const string& callsign) override;
+    Core::hresult Deactivate(const string& callsign) override;
+    Core::hresult Unavailable(const string& callsign) override;
+    Core::hresult Hibernate(const string& callsign, const uint32_t timeout) override;
+    Core::hresult Suspend(const string& callsign) override;
+    Core::hresult Resume(const string& callsign) override;
+
+    // ISubsystems
+    Core::hresult Register(ISubsystems::INotification* sink) override;
+    Core::hresult Unregister(ISubsystems::INotification* sink) override;
+    Core::hresult Subsystems(ISubsystems::ISubsystemsIterator*& subsystems) const override;
+
+    // IMetadata
+    Core::hresult Services(const string& callsign, IMetadata::Data::IServicesIterator*& services) const override;
+
+    BEGIN_INTERFACE_MAP(MockController)
+    INTERFACE_ENTRY(Exchange::Controller::ILifeTime)
+    INTERFACE_ENTRY(Exchange::Controller::ISubsystems)
+    INTERFACE_ENTRY(Exchange::Controller::IMetadata)
+    END_INTERFACE_MAP
+
+private:
+    Behaviour behaviour(const string& callsign) const;
+    IMetadata::Data::Service service(const string& callsign) const;
+    uint32_t activate(const string& callsign, const Behaviour& behaviour);
+    void changeState(const string& callsign, const PluginHost::IShell::state state, const PluginHost::IShell::reason reason);
+    void subsystemTimer();
+
+private:
+    const Behaviour _defaultBehaviour;
+    const uint32_t _preconditionDelayMs;
+
+    mutable std::mutex _lock;
+    std::map<string, Behaviour> _behaviours;
+    std::map<string, PluginHost::IShell::state> _states;
+    std::list<ILifeTime::INotification*> _lifetimeSinks;
+    std::list<ISubsystems::INotification*> _subsystemSinks;
+    std::minstd_rand _random;
+    Statistics _statistics;
+    bool _subsystemActive;
+
+    bool _running;
+    std::condition_variable _stopSignal;
+    std::thread _timer;
+};
@@ -0,0 +1,202 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Stand-alone mock Thunder Controller.
+ *
+ * Serves the Controller's lifetime interfaces over COM-RPC on a local socket so the activator (or
+ * ActivationBenchmark) can be run without a device. Point the activator at it by setting
+ * COMMUNICATOR_PATH to the socket path; the process names itself Thunder, so the activator's process
+ * discovery finds it like the real thing. Prints call statistics on exit (SIGINT/SIGTERM).
+ */
+
+#include "Module.h"
+
+#include "Log.h"
+#include "MockController.h"
+
+#include <signal.h>
+#include <sys/prctl.h>
+
+static string gSocketPath = "/tmp/MockController";
+static MockController::Behaviour gDefault = { 0, 0.0, false };
+static uint32_t gPreconditionDelayMs = 0;
+static std::vector<std::pair<string, MockController::Behaviour>> gPlugins;
+static int gLogLevel = LEVEL_INFO;
+
+static void displayUsage()
+{
+    printf("Usage: MockController <option(s)>\n");
+    printf("    Serve a mock Thunder Controller over COM-RPC\n\n");
+    printf("    -h, --help                  Print this help and exit\n");
+    printf("    -S, --socket                Socket to listen on (default /tmp/MockController)\n");
+    printf("    -l, --latency               Activation latency of every plugin in ms (default 0)\n");
+    printf("    -f, --failure-rate          Probability (0-1) an activation fails (default 0)\n");
+    printf("    -p, --precondition-delay    Time in ms until the simulated subsystem comes up. Every plugin\n");
+    printf("                                needs it unless configured otherwise (default 0, always up)\n");
+    printf("    -c, --plugin                Behaviour of one plugin, as callsign=latency[,failure-rate[,precondition]]\n");
+    printf("                                where precondition is 0 or 1. Can be given multiple times\n");
+    printf("    -v, --verbose               Increase log level\n");
+}
+
+/**
+ * @brief Parse a plugin behaviour, in the format "callsign=latency[,failure-rate[,precondition]]"
+ */
+static bool parsePlugin(const char* spec)
+{
+    const string value(spec);
+    const size_t equals = value.find('=');
+
+    if (equals == string::npos || equals == 0) {
+        return false;
+    }
+
+    MockController::Behaviour behaviour = gDefault;
+    behaviour.precondition = (gPreconditionDelayMs > 0);
+
+    unsigned int latency = 0;
+    double failureRate = 0.0;
+    int precondition = behaviour.precondition ? 1 : 0;
+
+    const int fields = sscanf(value.c_str() + equals + 1, "%u,%lf,%d", &latency, &failureRate, &precondition);
+    if (fields < 1 || failureRate < 0.0 || failureRate > 1.0) {
+        return false;
+    }
+
+    behaviour.latencyMs = latency;
+    if (fields >= 2) {
+        behaviour.failureRate = failureRate;
+    }
+    behaviour.precondition = (precondition != 0);
+
+    gPlugins.emplace_back(value.substr(0, equals), behaviour);
+    return true;
+}
+
+static void parseArgs(const int argc, char** argv)
+{
+    struct option longopts[] = {
+        { "help", no_argument, nullptr, (int)'h' },
+        { "socket", required_argument, nullptr, (int)'S' },
+        { "latency", required_argument, nullptr, (int)'l' },
+        { "failure-rate", required_argument, nullptr, (int)'f' },
+        { "precondition-delay", required_argument, nullptr, (int)'p' },
+        { "plugin", required_argument, nullptr, (int)'c' },
+        { "verbose", no_argument, nullptr, (int)'v' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int option;
+    int longindex;
+    std::vector<const char*> plugins;
+
+    while ((option = getopt_long(argc, argv, "hS:l:f:p:c:v", longopts, &longindex)) != -1) {
+        switch (option) {
+        case 'h':
+            displayUsage();
+            exit(EXIT_SUCCESS);
+            break;
+        case 'S':
+            gSocketPath = optarg;
+            break;
+        case 'l':
+            gDefault.latencyMs = std::atoi(optarg);
+            break;
+        case 'f':
+            gDefault.failureRate = std::atof(optarg);
+            if (gDefault.failureRate < 0.0 || gDefault.failureRate > 1.0) {
+                fprintf(stderr, "Error: Failure rate must be between 0 and 1\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            gPreconditionDelayMs = std::atoi(optarg);
+            break;
+        case 'c':
+            // Parsed once all the defaults are known
+            plugins.push_back(optarg);
+            break;
+        case 'v':
+            gLogLevel++;
+            break;
+        default:
+            displayUsage();
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    gDefault.precondition = (gPreconditionDelayMs > 0);
+
+    for (const char* spec : plugins) {
+        if (!parsePlugin(spec)) {
+            fprintf(stderr, "Error: Invalid plugin behaviour '%s'\n", spec);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // Stand in for Thunder in /proc as well, the activator looks for it there before connecting
+    prctl(PR_SET_NAME, "Thunder", 0, 0, 0);
+
+    parseArgs(argc, argv);
+    initLogging(gLogLevel);
+
+    // Block the shutdown signals before any threads are started, so they can be waited for below
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    int exitCode = EXIT_SUCCESS;
+
+    {
+        Core::Sink<MockController> controller(gDefault, gPreconditionDelayMs);
+
+        for (const auto& plugin : gPlugins) {
+            controller.configure(plugin.first, plugin.second);
+        }
+
+        MockController::Server server(Core::NodeId(gSocketPath.c_str()), controller);
+
+        const uint32_t result = server.Open(RPC::CommunicationTimeOut);
+        if (result != Core::ERROR_NONE) {
+            LOG_ERROR("Mock", "Failed to listen on %s (%u)", gSocketPath.c_str(), result);
+            exitCode = EXIT_FAILURE;
+        } else {
+            LOG_INF("Mock", "Listening on %s", gSocketPath.c_str());
+
+            int signal = 0;
+            sigwait(&signals, &signal);
+
+            server.Close(Core::infinite);
+
+            const MockController::Statistics statistics = controller.statistics();
+            printf("calls=%u activations=%u deactivations=%u pending=%u failures=%u\n", statistics.calls,
+                statistics.activations, statistics.deactivations, statistics.pending, statistics.failures);
+            fflush(stdout);
+        }
+    }
+
+    Core::Singleton::Dispose();
+    return exitCode;
+}
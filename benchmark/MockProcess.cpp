@@ -0,0 +1,150 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MockProcess.h"
+
+#include "ProcessDiscovery.h"
+
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+// How long the mock gets to start listening
+static constexpr uint32_t kStartTimeoutMs = 5000;
+static constexpr uint32_t kStartPollMs = 5;
+
+MockProcess::MockProcess()
+    : _pid(-1)
+    , _output(-1)
+{
+}
+
+MockProcess::~MockProcess()
+{
+    stop();
+}
+
+/**
+ * @brief Path of an executable installed in the same directory as this one
+ */
+std::string MockProcess::siblingExecutable(const char* name)
+{
+    char path[PATH_MAX];
+    const ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+
+    if (length <= 0) {
+        return name;
+    }
+    path[length] = '\0';
+
+    std::string directory(path);
+    return directory.substr(0, directory.rfind('/') + 1) + name;
+}
+
+/**
+ * @brief Start the mock and wait until it accepts connections on the socket
+ */
+bool MockProcess::start(const std::string& socketPath, const std::vector<std::string>& arguments)
+{
+    const std::string executable = siblingExecutable("MockController");
+
+    std::vector<std::string> argv = { executable, "--socket", socketPath };
+    argv.insert(argv.end(), arguments.begin(), arguments.end());
+
+    std::vector<char*> args;
+    for (std::string& argument : argv) {
+        args.push_back(&argument[0]);
+    }
+    args.push_back(nullptr);
+
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) != 0) {
+        return false;
+    }
+
+    unlink(socketPath.c_str());
+
+    _pid = fork();
+    if (_pid == 0) {
+        dup2(pipeFds[1], STDOUT_FILENO);
+        execv(executable.c_str(), args.data());
+        fprintf(stderr, "Failed to run %s (%s)\n", executable.c_str(), strerror(errno));
+        _exit(127);
+    }
+
+    close(pipeFds[1]);
+    if (_pid < 0) {
+        close(pipeFds[0]);
+        return false;
+    }
+    _output = pipeFds[0];
+
+    for (uint32_t waited = 0; waited < kStartTimeoutMs; waited += kStartPollMs) {
+        if (isCommunicatorReachable(socketPath)) {
+            return true;
+        }
+        if (waitpid(_pid, nullptr, WNOHANG) == _pid) {
+            _pid = -1;
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(kStartPollMs));
+    }
+
+    stop();
+    return false;
+}
+
+/**
+ * @brief Shut the mock down
+ *
+ * @return The statistics line the mock printed on exit, empty if it was not running
+ */
+std::string MockProcess::stop()
+{
+    std::string output;
+
+    if (_pid > 0) {
+        kill(_pid, SIGTERM);
+        waitpid(_pid, nullptr, 0);
+        _pid = -1;
+    }
+
+    if (_output >= 0) {
+        char buffer[256];
+        ssize_t length;
+        while ((length = read(_output, buffer, sizeof(buffer))) > 0) {
+            output.append(buffer, length);
+        }
+        close(_output);
+        _output = -1;
+    }
+
+    while (!output.empty() && output.back() == '\n') {
+        output.pop_back();
+    }
+
+    return output;
+}
@@ -0,0 +1,49 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @brief Runs the MockController executable as a child process for the duration of a benchmark
+ *
+ * The mock is looked up next to the running benchmark executable. Its call statistics, printed when it
+ * shuts down, are returned by stop()
+ */
+class MockProcess {
+public:
+    MockProcess();
+    ~MockProcess();
+
+    MockProcess(const MockProcess&) = delete;
+    MockProcess& operator=(const MockProcess&) = delete;
+
+    bool start(const std::string& socketPath, const std::vector<std::string>& arguments);
+    std::string stop();
+
+    static std::string siblingExecutable(const char* name);
+
+private:
+    pid_t _pid;
+    int _output;
+};
@@ -0,0 +1,169 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Measures activation latency and throughput of the COM-RPC and JSON-RPC starters against a
+ * running Thunder instance.
+ *
+ * Repeatedly deactivates and activates the given plugin through each transport and reports the
+ * latency distribution of each call, the cost of the first (connecting) call and the overall
+ * throughput. The plugin is left activated afterwards.
+ */
+
+#include "Module.h"
+
+#include "BenchmarkStats.h"
+#include "COMRPCStarter.h"
+#include "JSONRPCStarter.h"
+#include "Log.h"
+
+#include <memory>
+
+static int gIterations = 20;
+static bool gCOMRPC = true;
+static bool gJSONRPC = true;
+static string gCallsign;
+
+static void displayUsage()
+{
+    printf("Usage: TransportBenchmark <option(s)> [callsign]\n");
+    printf("    Benchmark plugin activation over COM-RPC and JSON-RPC\n\n");
+    printf("    -h, --help          Print this help and exit\n");
+    printf("    -n, --iterations    Number of deactivate/activate cycles per transport (default 20)\n");
+    printf("    -P, --transport     comrpc, jsonrpc or both (default)\n");
+    printf("\n");
+    printf("    [callsign]          Callsign of the plugin to cycle (Required)\n");
+}
+
+static void parseArgs(const int argc, char** argv)
+{
+    struct option longopts[] = {
+        { "help", no_argument, nullptr, (int)'h' },
+        { "iterations", required_argument, nullptr, (int)'n' },
+        { "transport", required_argument, nullptr, (int)'P' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int option;
+    int longindex;
+
+    while ((option = getopt_long(argc, argv, "hn:P:", longopts, &longindex)) != -1) {
+        switch (option) {
+        case 'h':
+            displayUsage();
+            exit(EXIT_SUCCESS);
+            break;
+        case 'n':
+            gIterations = std::atoi(optarg);
+            if (gIterations < 1) {
+                fprintf(stderr, "Error: Iterations must be > 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'P':
+            gCOMRPC = (strcmp(optarg, "comrpc") == 0 || strcmp(optarg, "both") == 0);
+            gJSONRPC = (strcmp(optarg, "jsonrpc") == 0 || strcmp(optarg, "both") == 0);
+            if (!gCOMRPC && !gJSONRPC) {
+                fprintf(stderr, "Error: Unknown transport '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            displayUsage();
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    if (optind == argc) {
+        fprintf(stderr, "Error: Must provide plugin name to benchmark\n");
+        exit(EXIT_FAILURE);
+    }
+
+    gCallsign = argv[optind];
+}
+
+static bool benchmark(const char* name, IPluginStarter& starter)
+{
+    // A single attempt, we're measuring the transport not the retry logic
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 1, 0, 0, 0);
+
+    BenchmarkStats activate;
+    BenchmarkStats deactivate;
+
+    // The first call includes opening the connection
+    auto start = std::chrono::steady_clock::now();
+    if (!starter.deactivatePlugin(gCallsign, policy)) {
+        fprintf(stderr, "%s: Failed to deactivate %s\n", name, gCallsign.c_str());
+        return false;
+    }
+    const uint64_t firstCallUs = elapsedUs(start);
+
+    const auto begin = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < gIterations; i++) {
+        start = std::chrono::steady_clock::now();
+        if (!starter.activatePlugin(gCallsign, policy)) {
+            fprintf(stderr, "%s: Failed to activate %s\n", name, gCallsign.c_str());
+            return false;
+        }
+        activate.add(elapsedUs(start));
+
+        start = std::chrono::steady_clock::now();
+        if (!starter.deactivatePlugin(gCallsign, policy)) {
+            fprintf(stderr, "%s: Failed to deactivate %s\n", name, gCallsign.c_str());
+            return false;
+        }
+        deactivate.add(elapsedUs(start));
+    }
+
+    const uint64_t totalUs = elapsedUs(begin);
+    starter.activatePlugin(gCallsign, policy);
+
+    printf("\n%s (%d iterations, first call incl. connect %lluus, %.1f calls/s)\n", name, gIterations,
+        static_cast<unsigned long long>(firstCallUs), (2.0 * gIterations * 1000000.0) / totalUs);
+    BenchmarkStats::printHeader();
+    activate.print("activate");
+    deactivate.print("deactivate");
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    parseArgs(argc, argv);
+
+    // Keep logging off the measured path
+    initLogging(LEVEL_ERROR);
+
+    bool success = true;
+
+    if (gCOMRPC) {
+        COMRPCStarter starter;
+        success = benchmark("COM-RPC", starter) && success;
+    }
+
+    if (gJSONRPC) {
+        JSONRPCStarter starter;
+        success = benchmark("JSON-RPC", starter) && success;
+    }
+
+    Core::Singleton::Dispose();
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,433 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ActivationEngine.h"
+
+#include "AdmissionControl.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <thread>
+
+ActivationEngine::ActivationEngine(const StarterFactory& factory, const uint8_t maxWorkers, const Operation operation)
+    : _factory(factory)
+    , _maxWorkers(std::max<uint8_t>(maxWorkers, 1))
+    , _operation(operation)
+    , _nodes()
+    , _index()
+    , _lock()
+    , _changed()
+    , _ready()
+    , _remaining(0)
+    , _inFlight(0)
+    , _hasDeadline(false)
+    , _deadline()
+    , _expired(false)
+{
+}
+
+/**
+ * @brief Add a plugin to be activated
+ *
+ * Adding the same callsign more than once has no effect
+ */
+void ActivationEngine::addPlugin(const std::string& callsign, const PluginOptions& options)
+{
+    if (_index.find(callsign) != _index.end()) {
+        return;
+    }
+
+    _index[callsign] = _nodes.size();
+    _nodes.push_back({ callsign, options, {}, 0, Outcome::Pending, false, 0 });
+}
+
+/**
+ * @brief Record that a plugin must not be activated until another plugin has activated
+ *
+ * When deactivating or hibernating the dependency is reversed: the other plugin is not taken down until
+ * this one has been. Both plugins must already have been added. Dependencies on plugins that are not part of
+ * this run are ignored, as there is nothing to wait for
+ *
+ * @param[in]   callsign    Plugin that has the dependency
+ * @param[in]   dependsOn   Plugin that must be activated first
+ */
+void ActivationEngine::addDependency(const std::string& callsign, const std::string& dependsOn)
+{
+    const char* verb = IPluginStarter::operationName(_operation);
+
+    if (_index.find(callsign) == _index.end()) {
+        LOG_WARN(callsign.c_str(), "Ignoring dependency on %s - not asked to %s the plugin", dependsOn.c_str(), verb);
+        return;
+    }
+
+    if (_index.find(dependsOn) == _index.end()) {
+        LOG_WARN(callsign.c_str(), "Ignoring dependency on %s - not asked to %s the dependency", dependsOn.c_str(), verb);
+        return;
+    }
+
+    // The graph is kept in the order the operations run in
+    const bool reversed = IPluginStarter::reversesDependencies(_operation);
+    auto node = _index.find(reversed ? dependsOn : callsign);
+    auto parent = _index.find(reversed ? callsign : dependsOn);
+
+    std::vector<size_t>& dependents = _nodes[parent->second].dependents;
+    if (std::find(dependents.begin(), dependents.end(), node->second) == dependents.end()) {
+        dependents.push_back(node->second);
+        _nodes[node->second].outstanding++;
+    }
+}
+
+/**
+ * @brief Run the operation on all the plugins, honouring their dependencies
+ *
+ * Blocks until every plugin has either been activated, failed, been skipped because one of its
+ * dependencies failed or timed out. Operations still in progress at the deadline are reported as timed
+ * out, their calls and retries are cut short at the deadline
+ *
+ * @param[in]   policy          How to retry a failed operation on each plugin
+ * @param[in]   deadlineMs      Time allowed for the whole run, 0 for no limit
+ *
+ * @return True if the operation succeeded on all plugins
+ */
+bool ActivationEngine::run(const RetryPolicy& policy, const uint32_t deadlineMs)
+{
+    std::vector<size_t> order;
+    if (!validate(order)) {
+        return false;
+    }
+
+    computeCriticalPaths(order);
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        _ready.clear();
+        _remaining = _nodes.size();
+        _inFlight = 0;
+        _hasDeadline = (deadlineMs != 0);
+        _deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(deadlineMs);
+        _expired = false;
+
+        for (size_t i = 0; i < _nodes.size(); i++) {
+            if (_nodes[i].outstanding == 0) {
+                _ready.push_back(i);
+            }
+        }
+    }
+
+    const size_t workerCount = std::min<size_t>(_maxWorkers, _nodes.size());
+    LOG_DBG("Engine", "Running %s on %zu plugin(s) with %zu worker(s)", IPluginStarter::operationName(_operation), _nodes.size(), workerCount);
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < workerCount; i++) {
+        workers.emplace_back(&ActivationEngine::worker, this, std::cref(policy));
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    return std::all_of(_nodes.begin(), _nodes.end(), [](const Node& node) {
+        return node.outcome == Outcome::Succeeded;
+    });
+}
+
+std::vector<ActivationEngine::Result> ActivationEngine::results() const
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    std::vector<Result> results;
+    results.reserve(_nodes.size());
+
+    for (const Node& node : _nodes) {
+        results.push_back({ node.callsign, node.outcome });
+    }
+
+    return results;
+}
+
+/**
+ * @brief Check the dependency graph has no cycles (Kahn's algorithm)
+ *
+ * @param[out]  order   The plugins in a valid activation order
+ */
+bool ActivationEngine::validate(std::vector<size_t>& order) const
+{
+    std::vector<uint32_t> outstanding;
+    std::deque<size_t> ready;
+
+    for (size_t i = 0; i < _nodes.size(); i++) {
+        outstanding.push_back(_nodes[i].outstanding);
+        if (_nodes[i].outstanding == 0) {
+            ready.push_back(i);
+        }
+    }
+
+    size_t visited = 0;
+    while (!ready.empty()) {
+        const size_t index = ready.front();
+        ready.pop_front();
+        order.push_back(index);
+        visited++;
+
+        for (size_t dependent : _nodes[index].dependents) {
+            if (--outstanding[dependent] == 0) {
+                ready.push_back(dependent);
+            }
+        }
+    }
+
+    if (visited != _nodes.size()) {
+        for (size_t i = 0; i < _nodes.size(); i++) {
+            if (outstanding[i] != 0) {
+                LOG_ERROR(_nodes[i].callsign.c_str(), "Plugin is part of a dependency cycle");
+            }
+        }
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Work out the length of the longest dependency chain starting at each plugin
+ *
+ * Plugins without a known cost count as 1ms, so with no costs at all this is the number of plugins in
+ * the chain
+ *
+ * @param[in]   order   The plugins in a valid activation order, as produced by validate()
+ */
+void ActivationEngine::computeCriticalPaths(const std::vector<size_t>& order)
+{
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        Node& node = _nodes[*it];
+
+        uint64_t longestDependent = 0;
+        for (size_t dependent : node.dependents) {
+            longestDependent = std::max(longestDependent, _nodes[dependent].criticalPathMs);
+        }
+
+        node.criticalPathMs = std::max<uint32_t>(node.options.costMs, 1) + longestDependent;
+    }
+
+    // The longest chain always starts at a plugin with no dependencies of its own
+    if (!_nodes.empty()) {
+        auto head = std::max_element(_nodes.begin(), _nodes.end(), [](const Node& lhs, const Node& rhs) {
+            return lhs.criticalPathMs < rhs.criticalPathMs;
+        });
+        LOG_DBG("Engine", "Critical path starts at %s (%llums)", head->callsign.c_str(), static_cast<unsigned long long>(head->criticalPathMs));
+    }
+}
+
+/**
+ * @brief Whether plugin lhs should be activated before plugin rhs when both are ready
+ */
+bool ActivationEngine::runsBefore(const size_t lhs, const size_t rhs) const
+{
+    const Node& left = _nodes[lhs];
+    const Node& right = _nodes[rhs];
+
+    if (left.options.priority != right.options.priority) {
+        return left.options.priority > right.options.priority;
+    }
+    if (left.criticalPathMs != right.criticalPathMs) {
+        return left.criticalPathMs > right.criticalPathMs;
+    }
+    // Otherwise keep the order the plugins were given in
+    return lhs < rhs;
+}
+
+void ActivationEngine::worker(const RetryPolicy& policy)
+{
+    std::unique_ptr<IPluginStarter> starter = _factory();
+
+    std::unique_lock<std::mutex> lock(_lock);
+
+    while (_remaining > 0) {
+        if (!_expired && deadlineHit()) {
+            timeOutPending();
+            continue;
+        }
+
+        if (_ready.empty()) {
+            if (_hasDeadline && !_expired) {
+                _changed.wait_until(lock, _deadline);
+            } else {
+                _changed.wait(lock);
+            }
+            continue;
+        }
+
+        // Under pressure the plugins in flight are let finish before adding more load, one is always allowed.
+        // Sampling reads /proc, so it is done without the lock to not hold up the other workers
+        if (_inFlight > 0) {
+            lock.unlock();
+            const bool admit = admitted();
+            lock.lock();
+
+            if (!admit) {
+                auto wake = std::chrono::steady_clock::now() + std::chrono::milliseconds(AdmissionControl::pollIntervalMs());
+                if (_hasDeadline && !_expired) {
+                    wake = std::min(wake, _deadline);
+                }
+                _changed.wait_until(lock, wake);
+                continue;
+            }
+
+            // Another worker may have taken the last ready plugin, or the deadline passed, in the meantime
+            if (_ready.empty() || (!_expired && deadlineHit())) {
+                continue;
+            }
+        }
+
+        auto next = std::min_element(_ready.begin(), _ready.end(), [this](const size_t lhs, const size_t rhs) {
+            return runsBefore(lhs, rhs);
+        });
+        const size_t index = *next;
+        _ready.erase(next);
+
+        const std::string callsign = _nodes[index].callsign;
+        const RetryPolicy nodePolicy = boundedPolicy(_nodes[index].options.hasPolicy ? _nodes[index].options.policy : policy);
+        _nodes[index].started = true;
+        _inFlight++;
+
+        lock.unlock();
+        const bool success = starter->execute(callsign, _operation, nodePolicy);
+        lock.lock();
+
+        Node& node = _nodes[index];
+        _inFlight--;
+
+        // Already reported as timed out at the deadline, whatever the outcome
+        if (node.outcome == Outcome::TimedOut) {
+            _changed.notify_all();
+            continue;
+        }
+
+        _remaining--;
+
+        if (success) {
+            node.outcome = Outcome::Succeeded;
+
+            for (size_t dependent : node.dependents) {
+                // A dependent may already have been skipped due to a different dependency failing
+                if (--_nodes[dependent].outstanding == 0 && _nodes[dependent].outcome == Outcome::Pending) {
+                    _ready.push_back(dependent);
+                }
+            }
+        } else {
+            node.outcome = Outcome::Failed;
+            skipDependents(index);
+        }
+
+        _changed.notify_all();
+    }
+}
+
+/**
+ * @brief Mark everything depending on a failed plugin as skipped
+ *
+ * Must be called with the lock held
+ */
+void ActivationEngine::skipDependents(const size_t index)
+{
+    for (size_t dependent : _nodes[index].dependents) {
+        Node& node = _nodes[dependent];
+
+        if (node.outcome == Outcome::Pending) {
+            const char* verb = IPluginStarter::operationName(_operation);
+
+            if (IPluginStarter::reversesDependencies(_operation)) {
+                LOG_ERROR(node.callsign.c_str(), "Skipping %s - failed to %s dependent %s", verb, verb, _nodes[index].callsign.c_str());
+            } else {
+                LOG_ERROR(node.callsign.c_str(), "Skipping %s - failed to %s dependency %s", verb, verb, _nodes[index].callsign.c_str());
+            }
+            node.outcome = Outcome::Skipped;
+            _remaining--;
+            skipDependents(dependent);
+        }
+    }
+}
+
+bool ActivationEngine::deadlineHit() const
+{
+    return _hasDeadline && std::chrono::steady_clock::now() >= _deadline;
+}
+
+/**
+ * @brief Give up on every plugin that hasn't finished yet
+ *
+ * Plugins still being worked on are reported as timed out too. Their calls and retries are bounded by the
+ * deadline (see boundedPolicy()), so their workers return straight after it. Must be called with the lock held
+ */
+void ActivationEngine::timeOutPending()
+{
+    for (Node& node : _nodes) {
+        if (node.outcome != Outcome::Pending) {
+            continue;
+        }
+
+        if (node.started) {
+            LOG_ERROR(node.callsign.c_str(), "Deadline hit - giving up on the %s in progress", IPluginStarter::operationName(_operation));
+        } else {
+            LOG_ERROR(node.callsign.c_str(), "Deadline hit - did not get to %s the plugin", IPluginStarter::operationName(_operation));
+        }
+        node.outcome = Outcome::TimedOut;
+        _remaining--;
+    }
+
+    _ready.clear();
+    _expired = true;
+    _changed.notify_all();
+}
+
+/**
+ * @brief Whether another plugin may be started now, only activating and resuming add load to the system
+ */
+bool ActivationEngine::admitted() const
+{
+    if (_operation != Operation::Activate && _operation != Operation::Resume) {
+        return true;
+    }
+    return !AdmissionControl::instance().overloaded();
+}
+
+/**
+ * @brief Limit a plugin's retry policy so it gives up no later than the overall deadline
+ *
+ * The starters also cut each call short at the policy's call deadline, so this bounds calls that hang as
+ * well. A shorter deadline of the plugin's own (e.g. fitted from the activation history) still stops its
+ * retries first
+ */
+RetryPolicy ActivationEngine::boundedPolicy(const RetryPolicy& policy) const
+{
+    if (!_hasDeadline) {
+        return policy;
+    }
+
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(_deadline - std::chrono::steady_clock::now()).count();
+    const uint32_t remainingMs = static_cast<uint32_t>(std::max<long long>(remaining, 1));
+
+    const uint32_t deadlineMs = (policy.deadlineMs() != 0) ? std::min(policy.deadlineMs(), remainingMs) : remainingMs;
+    const uint32_t callDeadlineMs = (policy.callDeadlineMs() != 0) ? std::min(policy.callDeadlineMs(), remainingMs) : remainingMs;
+
+    RetryPolicy bounded(policy.backoff(), policy.maxAttempts(), policy.delayMs(), policy.maxDelayMs(), deadlineMs, callDeadlineMs);
+    bounded.callTimeoutMs(policy.callTimeoutMs());
+    return bounded;
+}
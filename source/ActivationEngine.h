@@ -0,0 +1,146 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "IPluginStarter.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Activates a set of plugins in dependency order on a bounded pool of workers
+ *
+ * The plugins and the dependencies between them form a DAG. Plugins with no outstanding dependencies
+ * are activated concurrently, and a plugin is released to the workers as soon as all the plugins it
+ * depends on have activated. If a plugin fails to activate, everything that depends on it (directly or
+ * indirectly) is skipped.
+ *
+ * Each worker owns its own starter (and so its own connection and ILifeTime reference) so a slow
+ * activation on one worker never blocks another
+ *
+ * When more plugins are ready than there are free workers, the plugin with the highest priority goes
+ * first, then the one at the head of the longest remaining dependency chain (weighted by the expected
+ * activation cost of each plugin), so the critical path of the boot is started as early as possible
+ *
+ * The engine can also run the other lifecycle operations on a set of plugins. Deactivating and hibernating
+ * (for standby and shutdown) follow the dependencies in reverse: a plugin is only taken down once everything
+ * that depends on it has been, with independent branches torn down concurrently. Resuming follows them
+ * forwards, like activating.
+ *
+ * While the system is under pressure (see AdmissionControl) activating and resuming are held back to one
+ * plugin at a time, ramping back up to the full number of workers as the pressure drops.
+ *
+ * An overall deadline can be given to bound the whole run. Calls and retries are cut short at the deadline
+ * and plugins not finished by then are reported as timed out rather than waited on
+ */
+class ActivationEngine {
+public:
+    using StarterFactory = std::function<std::unique_ptr<IPluginStarter>()>;
+
+    using Operation = IPluginStarter::Operation;
+
+    enum class Outcome {
+        Pending,
+        Succeeded,
+        Failed,
+        Skipped,
+        TimedOut
+    };
+
+    struct Result {
+        std::string callsign;
+        Outcome outcome;
+    };
+
+    struct PluginOptions {
+        PluginOptions()
+            : priority(0)
+            , costMs(0)
+            , hasPolicy(false)
+            , policy()
+        {
+        }
+
+        int32_t priority;
+        uint32_t costMs; // Expected activation time, 0 if unknown
+        bool hasPolicy;
+        RetryPolicy policy; // Replaces the policy passed to run() if hasPolicy is set
+    };
+
+public:
+    ActivationEngine(const StarterFactory& factory, const uint8_t maxWorkers, const Operation operation = Operation::Activate);
+    ~ActivationEngine() = default;
+
+    ActivationEngine(const ActivationEngine&) = delete;
+    ActivationEngine& operator=(const ActivationEngine&) = delete;
+
+    void addPlugin(const std::string& callsign, const PluginOptions& options = PluginOptions());
+    void addDependency(const std::string& callsign, const std::string& dependsOn);
+
+    bool run(const RetryPolicy& policy, const uint32_t deadlineMs = 0);
+
+    std::vector<Result> results() const;
+
+private:
+    struct Node {
+        std::string callsign;
+        PluginOptions options;
+        std::vector<size_t> dependents;
+        uint32_t outstanding;
+        Outcome outcome;
+        bool started;
+        uint64_t criticalPathMs;
+    };
+
+private:
+    bool validate(std::vector<size_t>& order) const;
+    void computeCriticalPaths(const std::vector<size_t>& order);
+    bool runsBefore(const size_t lhs, const size_t rhs) const;
+    void worker(const RetryPolicy& policy);
+    void skipDependents(const size_t index);
+    bool deadlineHit() const;
+    void timeOutPending();
+    RetryPolicy boundedPolicy(const RetryPolicy& policy) const;
+    bool admitted() const;
+
+private:
+    const StarterFactory _factory;
+    const uint8_t _maxWorkers;
+    const Operation _operation;
+
+    std::vector<Node> _nodes;
+    std::map<std::string, size_t> _index;
+
+    mutable std::mutex _lock;
+    std::condition_variable _changed;
+    std::vector<size_t> _ready;
+    size_t _remaining;
+    size_t _inFlight;
+    bool _hasDeadline;
+    std::chrono::steady_clock::time_point _deadline;
+    bool _expired;
+};
@@ -0,0 +1,297 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ActivationHistory.h"
+
+#include "Log.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// Number of recent activations remembered per plugin
+static constexpr size_t kWindow = 16;
+
+// Don't adapt anything until the plugin has been seen activating a few times
+static constexpr uint32_t kMinSamples = 3;
+
+// Retry about four times within the time the plugin usually takes to come up
+static constexpr uint32_t kDelayDivisor = 4;
+
+// Give up after several times the slowest recent activation, but never too quickly
+static constexpr uint32_t kDeadlineFactor = 4;
+static constexpr uint32_t kMinDeadlineMs = 5000;
+
+static constexpr const char* kFileHeader = "# PluginActivator activation history v1";
+
+/**
+ * @brief Make a rename into the file's directory durable
+ */
+static void syncDirectory(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    const std::string directory = (slash == std::string::npos) ? "." : (slash == 0) ? "/" : path.substr(0, slash);
+
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) != 0) {
+        LOG_WARN("History", "Cannot sync %s (%s)", directory.c_str(), strerror(errno));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static uint32_t percentile(std::vector<uint32_t>& values, const uint32_t percent)
+{
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (values.size() * percent) / 100)];
+}
+
+ActivationHistory::ActivationHistory()
+    : _path()
+    , _lock()
+    , _samples()
+    , _unsaved()
+{
+}
+
+ActivationHistory& ActivationHistory::instance()
+{
+    static ActivationHistory history;
+    return history;
+}
+
+/**
+ * @brief Load the history from the file, which is created on the first save() if it doesn't exist
+ */
+bool ActivationHistory::open(const std::string& path)
+{
+    Samples samples;
+
+    if (access(path.c_str(), F_OK) == 0 && !read(path, samples)) {
+        LOG_ERROR("History", "Cannot read activation history %s (%s)", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_lock);
+    _path = path;
+    _samples.swap(samples);
+
+    LOG_DBG("History", "Loaded history for %zu plugin(s) from %s", _samples.size(), path.c_str());
+    return true;
+}
+
+/**
+ * @brief Remember a successful activation
+ *
+ * @param[in]   callsign        Plugin that was activated
+ * @param[in]   activationMs    How long the successful Activate call took
+ * @param[in]   totalMs         Time from the first attempt until the plugin was activated
+ */
+void ActivationHistory::record(const std::string& callsign, const uint32_t activationMs, const uint32_t totalMs)
+{
+    if (!enabled()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_lock);
+
+    add(_samples, callsign, Sample(activationMs, totalMs));
+    _unsaved.emplace_back(callsign, Sample(activationMs, totalMs));
+}
+
+/**
+ * @return False if there is not enough history for the plugin to go on
+ */
+bool ActivationHistory::estimate(const std::string& callsign, Estimate& estimate) const
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    auto samples = _samples.find(callsign);
+    if (samples == _samples.end() || samples->second.size() < kMinSamples) {
+        return false;
+    }
+
+    std::vector<uint32_t> activation;
+    std::vector<uint32_t> total;
+
+    for (const Sample& sample : samples->second) {
+        activation.push_back(sample.first);
+        total.push_back(sample.second);
+    }
+
+    estimate.samples = static_cast<uint32_t>(samples->second.size());
+    estimate.activationP50Ms = percentile(activation, 50);
+    estimate.activationP95Ms = percentile(activation, 95);
+    estimate.totalP50Ms = percentile(total, 50);
+    estimate.totalP95Ms = percentile(total, 95);
+
+    return true;
+}
+
+/**
+ * @brief Fit a retry policy to how the plugin has behaved before
+ *
+ * The retry delay is stretched for plugins that usually take a while to come up, and plugins without
+ * a deadline get one based on their slowest recent activations. Never makes the delay shorter, and
+ * never changes an explicit deadline.
+ *
+ * A fitted deadline only stops the retrying, it doesn't cut calls short: a plugin that is merely slower
+ * than usual must not be abandoned as hung just because history is enabled
+ */
+RetryPolicy ActivationHistory::adapt(const RetryPolicy& policy, const Estimate& estimate)
+{
+    const uint32_t delayMs = std::min(std::max(policy.delayMs(), estimate.totalP50Ms / kDelayDivisor), policy.maxDelayMs());
+
+    uint32_t deadlineMs = policy.deadlineMs();
+
+    if (deadlineMs == 0) {
+        const uint64_t fittedMs = static_cast<uint64_t>(estimate.totalP95Ms) * kDeadlineFactor;
+        deadlineMs = static_cast<uint32_t>(std::min<uint64_t>(std::max<uint64_t>(kMinDeadlineMs, fittedMs), UINT32_MAX));
+    }
+
+    RetryPolicy adapted(policy.backoff(), policy.maxAttempts(), delayMs, policy.maxDelayMs(), deadlineMs, policy.callDeadlineMs());
+    adapted.callTimeoutMs(policy.callTimeoutMs());
+    return adapted;
+}
+
+/**
+ * @brief Merge the samples recorded by this run into the history file
+ */
+void ActivationHistory::save()
+{
+    std::vector<std::pair<std::string, Sample>> unsaved;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        unsaved.swap(_unsaved);
+    }
+
+    if (!enabled() || unsaved.empty()) {
+        return;
+    }
+
+    // Lock a separate file, the history file itself is replaced by the rename below
+    const std::string lockPath = _path + ".lock";
+    int lockFd = ::open(lockPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (lockFd < 0) {
+        LOG_ERROR("History", "Cannot open %s (%s)", lockPath.c_str(), strerror(errno));
+        return;
+    }
+
+    flock(lockFd, LOCK_EX);
+
+    // Pick up anything other activators have saved since we loaded the file
+    Samples samples;
+    read(_path, samples);
+
+    for (const auto& sample : unsaved) {
+        add(samples, sample.first, sample.second);
+    }
+
+    const std::string temporaryPath = _path + ".tmp";
+    bool written = false;
+
+    FILE* file = fopen(temporaryPath.c_str(), "we");
+    if (file != nullptr) {
+        fprintf(file, "%s\n", kFileHeader);
+
+        for (const auto& plugin : samples) {
+            fprintf(file, "%s", plugin.first.c_str());
+            for (const Sample& sample : plugin.second) {
+                fprintf(file, " %u,%u", sample.first, sample.second);
+            }
+            fprintf(file, "\n");
+        }
+
+        // The history has to survive a reboot, so it must be on disk before it replaces the previous one
+        written = (ferror(file) == 0 && fflush(file) == 0 && fsync(fileno(file)) == 0);
+        written = (fclose(file) == 0) && written;
+    }
+
+    // Never replace the history with a partly written file (e.g. when the disk is full)
+    if (!written) {
+        LOG_ERROR("History", "Failed to write %s, keeping the previous history", temporaryPath.c_str());
+        unlink(temporaryPath.c_str());
+    } else if (rename(temporaryPath.c_str(), _path.c_str()) != 0) {
+        LOG_ERROR("History", "Failed to replace %s (%s)", _path.c_str(), strerror(errno));
+        unlink(temporaryPath.c_str());
+        written = false;
+    } else {
+        syncDirectory(_path);
+    }
+
+    flock(lockFd, LOCK_UN);
+    close(lockFd);
+
+    // Try again with the next save
+    if (!written) {
+        std::lock_guard<std::mutex> lock(_lock);
+        _unsaved.insert(_unsaved.begin(), unsaved.begin(), unsaved.end());
+    }
+}
+
+/**
+ * @brief Parse a history file, lines are "<callsign> <activation ms>,<total ms> ..." oldest first
+ */
+bool ActivationHistory::read(const std::string& path, Samples& samples)
+{
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        std::string callsign;
+        std::string field;
+
+        fields >> callsign;
+        while (fields >> field) {
+            unsigned int activationMs;
+            unsigned int totalMs;
+
+            if (sscanf(field.c_str(), "%u,%u", &activationMs, &totalMs) == 2) {
+                add(samples, callsign, Sample(activationMs, totalMs));
+            }
+        }
+    }
+
+    return true;
+}
+
+void ActivationHistory::add(Samples& samples, const std::string& callsign, const Sample& sample)
+{
+    std::deque<Sample>& window = samples[callsign];
+
+    window.push_back(sample);
+    while (window.size() > kWindow) {
+        window.pop_front();
+    }
+}
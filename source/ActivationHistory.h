@@ -0,0 +1,89 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "RetryPolicy.h"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Remembers how long each plugin took to activate across runs (and reboots)
+ *
+ * Keeps the most recent successful activations of every plugin in a small text file, one line per
+ * plugin. Each sample is the time the successful Activate call took and the total time including
+ * failed attempts and retry waits. Estimates are percentiles over those recent samples.
+ *
+ * The estimates let the activator order parallel activations by expected cost and fit the retry
+ * policy to the plugin: a plugin that reliably takes seconds is retried less often, and a plugin
+ * that reliably takes milliseconds is given up on sooner than the full default budget.
+ *
+ * Several activators may update the file at the same time, so save() merges its new samples with
+ * whatever is on disk under a lock and atomically replaces the file
+ */
+class ActivationHistory {
+public:
+    struct Estimate {
+        uint32_t samples;
+        uint32_t activationP50Ms;
+        uint32_t activationP95Ms;
+        uint32_t totalP50Ms;
+        uint32_t totalP95Ms;
+    };
+
+public:
+    static ActivationHistory& instance();
+
+    bool open(const std::string& path);
+    bool enabled() const { return !_path.empty(); }
+
+    void record(const std::string& callsign, const uint32_t activationMs, const uint32_t totalMs);
+    bool estimate(const std::string& callsign, Estimate& estimate) const;
+    void save();
+
+    static RetryPolicy adapt(const RetryPolicy& policy, const Estimate& estimate);
+
+private:
+    // Activate call time and total time, in ms
+    using Sample = std::pair<uint32_t, uint32_t>;
+    using Samples = std::map<std::string, std::deque<Sample>>;
+
+private:
+    ActivationHistory();
+    ~ActivationHistory() = default;
+
+    ActivationHistory(const ActivationHistory&) = delete;
+    ActivationHistory& operator=(const ActivationHistory&) = delete;
+
+    static bool read(const std::string& path, Samples& samples);
+    static void add(Samples& samples, const std::string& callsign, const Sample& sample);
+
+private:
+    std::string _path;
+
+    mutable std::mutex _lock;
+    Samples _samples;
+    std::vector<std::pair<std::string, Sample>> _unsaved;
+};
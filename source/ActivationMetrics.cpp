@@ -0,0 +1,416 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Module.h"
+
+#include "ActivationMetrics.h"
+#include "Log.h"
+#include "SharedTable.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace WPEFramework;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "Shared metrics need lock-free atomics");
+
+static constexpr uint32_t kMagic = 0x4d415050; // "PPAM"
+static constexpr uint32_t kVersion = 3;
+
+static constexpr size_t kMaxPlugins = 256;
+static constexpr size_t kMaxErrors = 1024;
+static constexpr size_t kCallsignLength = 64;
+
+// Upper bounds of the histogram buckets in ms, the last bucket catches everything above
+static constexpr uint32_t kBucketBoundsMs[] = { 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000 };
+static constexpr size_t kBuckets = sizeof(kBucketBoundsMs) / sizeof(kBucketBoundsMs[0]) + 1;
+
+// Indexed by IPluginStarter::Operation
+static constexpr const char* kOperations[] = { "activate", "deactivate", "hibernate", "resume" };
+static constexpr uint32_t kOperationCount = sizeof(kOperations) / sizeof(kOperations[0]);
+
+struct Histogram {
+    std::atomic<uint64_t> buckets[kBuckets];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sumUs;
+
+    void add(const uint64_t durationUs)
+    {
+        size_t bucket = 0;
+        while (bucket < kBuckets - 1 && durationUs > static_cast<uint64_t>(kBucketBoundsMs[bucket]) * 1000) {
+            bucket++;
+        }
+
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sumUs.fetch_add(durationUs, std::memory_order_relaxed);
+    }
+};
+
+struct PluginSlot {
+    std::atomic<uint32_t> state;
+    char callsign[kCallsignLength];
+    std::atomic<uint64_t> attempts[kOperationCount];
+    Histogram calls[kOperationCount];
+    std::atomic<uint64_t> retries;
+    std::atomic<uint64_t> givenUp;
+    Histogram activation;
+};
+
+struct ErrorSlot {
+    std::atomic<uint32_t> state;
+    uint32_t plugin;
+    uint32_t operation;
+    uint32_t code;
+    std::atomic<uint64_t> count;
+};
+
+/**
+ * @brief Layout of the metrics file. All zeroes is a valid, empty store
+ */
+struct ActivationMetrics::Store {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t reserved;
+    Histogram connect;
+    std::atomic<uint64_t> connectFailures;
+    std::atomic<uint64_t> dropped;
+    PluginSlot plugins[kMaxPlugins];
+    ErrorSlot errors[kMaxErrors];
+};
+
+/**
+ * @brief Escape a Prometheus label value
+ */
+static std::string escape(const char* value)
+{
+    std::string escaped;
+
+    for (const char* c = value; *c != '\0'; c++) {
+        if (*c == '\\' || *c == '"') {
+            escaped += '\\';
+            escaped += *c;
+        } else if (*c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += *c;
+        }
+    }
+
+    return escaped;
+}
+
+static void printHistogram(FILE* output, const char* name, const std::string& labels, const Histogram& histogram)
+{
+    const std::string separator = labels.empty() ? "" : ",";
+    uint64_t cumulative = 0;
+
+    for (size_t bucket = 0; bucket < kBuckets; bucket++) {
+        cumulative += histogram.buckets[bucket].load(std::memory_order_relaxed);
+
+        if (bucket < kBuckets - 1) {
+            fprintf(output, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels.c_str(), separator.c_str(), kBucketBoundsMs[bucket] / 1000.0, static_cast<unsigned long long>(cumulative));
+        } else {
+            fprintf(output, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels.c_str(), separator.c_str(), static_cast<unsigned long long>(cumulative));
+        }
+    }
+
+    const std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    fprintf(output, "%s_sum%s %.6f\n", name, braces.c_str(), histogram.sumUs.load(std::memory_order_relaxed) / 1000000.0);
+    fprintf(output, "%s_count%s %llu\n", name, braces.c_str(), static_cast<unsigned long long>(histogram.count.load(std::memory_order_relaxed)));
+}
+
+ActivationMetrics::ActivationMetrics()
+    : _store(nullptr)
+    , _lock()
+    , _slots()
+{
+}
+
+ActivationMetrics::~ActivationMetrics()
+{
+    if (_store != nullptr) {
+        munmap(_store, sizeof(Store));
+    }
+}
+
+ActivationMetrics& ActivationMetrics::instance()
+{
+    static ActivationMetrics metrics;
+    return metrics;
+}
+
+/**
+ * @brief Map the metrics file, creating it if it doesn't exist yet
+ */
+bool ActivationMetrics::open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Metrics", "Cannot open metrics file %s (%s)", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    // Only one process sizes and stamps a new file
+    flock(fd, LOCK_EX);
+
+    struct stat info;
+    bool valid = (fstat(fd, &info) == 0);
+
+    if (valid && info.st_size == 0 && ftruncate(fd, sizeof(Store)) != 0) {
+        valid = false;
+    }
+
+    void* mapping = MAP_FAILED;
+    if (valid) {
+        mapping = mmap(nullptr, sizeof(Store), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("Metrics", "Cannot map metrics file %s (%s)", path.c_str(), strerror(errno));
+        flock(fd, LOCK_UN);
+        close(fd);
+        return false;
+    }
+
+    Store* store = static_cast<Store*>(mapping);
+
+    if (store->magic == 0) {
+        store->version = kVersion;
+        store->size = sizeof(Store);
+        store->magic = kMagic;
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    if (store->magic != kMagic || store->version != kVersion || store->size != sizeof(Store)) {
+        LOG_ERROR("Metrics", "%s is not a metrics file of this version, remove it to start over", path.c_str());
+        munmap(mapping, sizeof(Store));
+        return false;
+    }
+
+    _store = store;
+    return true;
+}
+
+/**
+ * @brief Account for a timed phase, see ActivationTrace::Scope
+ */
+void ActivationMetrics::record(const char* phase, const std::string& callsign, const uint64_t durationUs, const uint32_t result)
+{
+    if (_store == nullptr) {
+        return;
+    }
+
+    if (strcmp(phase, "open") == 0) {
+        _store->connect.add(durationUs);
+        if (result != Core::ERROR_NONE) {
+            _store->connectFailures.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    uint32_t operation = 0;
+    while (operation < kOperationCount && strcmp(phase, kOperations[operation]) != 0) {
+        operation++;
+    }
+
+    const bool call = (operation < kOperationCount);
+    const bool retry = (strcmp(phase, "retry-wait") == 0);
+    const bool plugin = (strcmp(phase, "plugin") == 0);
+
+    if (!call && !retry && !plugin) {
+        return;
+    }
+
+    const int32_t index = this->plugin(callsign);
+    if (index < 0) {
+        return;
+    }
+
+    PluginSlot& slot = _store->plugins[index];
+
+    if (call) {
+        slot.attempts[operation].fetch_add(1, std::memory_order_relaxed);
+        slot.calls[operation].add(durationUs);
+
+        if (result != Core::ERROR_NONE) {
+            countError(index, operation, result);
+        }
+    } else if (retry) {
+        slot.retries.fetch_add(1, std::memory_order_relaxed);
+    } else if (result != Core::ERROR_NONE) {
+        slot.givenUp.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Account for a plugin having activated, durationUs being the time taken including retries
+ */
+void ActivationMetrics::recordActivation(const std::string& callsign, const uint64_t durationUs)
+{
+    if (_store == nullptr) {
+        return;
+    }
+
+    const int32_t index = plugin(callsign);
+    if (index >= 0) {
+        _store->plugins[index].activation.add(durationUs);
+    }
+}
+
+/**
+ * @brief Slot of a plugin, claiming one if this is the first time the plugin is seen by any activator
+ *
+ * @return Slot index, or -1 if there is no room left
+ */
+int32_t ActivationMetrics::plugin(const std::string& callsign)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    auto cached = _slots.find(callsign);
+    if (cached != _slots.end()) {
+        return cached->second;
+    }
+
+    // Longer callsigns are truncated, Thunder callsigns are nowhere near this long in practice
+    char name[kCallsignLength] = {};
+    strncpy(name, callsign.c_str(), sizeof(name) - 1);
+
+    const int32_t index = claimSlot(
+        _store->plugins, kMaxPlugins, hashName(name),
+        [&name](const PluginSlot& slot) { return strncmp(slot.callsign, name, sizeof(name)) == 0; },
+        [&name](PluginSlot& slot) { memcpy(slot.callsign, name, sizeof(name)); });
+
+    if (index < 0) {
+        _store->dropped.fetch_add(1, std::memory_order_relaxed);
+        LOG_WARN("Metrics", "No room left in the metrics file for %s", callsign.c_str());
+    }
+
+    _slots[callsign] = index;
+    return index;
+}
+
+void ActivationMetrics::countError(const int32_t plugin, const uint32_t operation, const uint32_t code)
+{
+    const size_t hash = (static_cast<size_t>(plugin) * 31 + operation) * 131 + code;
+
+    const int32_t index = claimSlot(
+        _store->errors, kMaxErrors, hash,
+        [plugin, operation, code](const ErrorSlot& slot) {
+            return slot.plugin == static_cast<uint32_t>(plugin) && slot.operation == operation && slot.code == code;
+        },
+        [plugin, operation, code](ErrorSlot& slot) {
+            slot.plugin = static_cast<uint32_t>(plugin);
+            slot.operation = operation;
+            slot.code = code;
+        });
+
+    if (index >= 0) {
+        _store->errors[index].count.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        _store->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Write all the metrics in the Prometheus text exposition format
+ */
+void ActivationMetrics::exportPrometheus(FILE* output) const
+{
+    if (_store == nullptr) {
+        return;
+    }
+
+    const Store& store = *_store;
+
+    std::vector<size_t> plugins;
+    std::vector<std::string> labels(kMaxPlugins);
+    for (size_t i = 0; i < kMaxPlugins; i++) {
+        if (store.plugins[i].state.load(std::memory_order_acquire) == Used) {
+            plugins.push_back(i);
+            labels[i] = "callsign=\"" + escape(store.plugins[i].callsign) + "\"";
+        }
+    }
+
+    fprintf(output, "# HELP pluginactivator_attempts_total Activate/deactivate calls made\n");
+    fprintf(output, "# TYPE pluginactivator_attempts_total counter\n");
+    for (size_t i : plugins) {
+        for (uint32_t operation = 0; operation < kOperationCount; operation++) {
+            fprintf(output, "pluginactivator_attempts_total{%s,operation=\"%s\"} %llu\n", labels[i].c_str(), kOperations[operation],
+                static_cast<unsigned long long>(store.plugins[i].attempts[operation].load(std::memory_order_relaxed)));
+        }
+    }
+
+    fprintf(output, "# HELP pluginactivator_call_failures_total Activate/deactivate calls that failed, by error code\n");
+    fprintf(output, "# TYPE pluginactivator_call_failures_total counter\n");
+    for (size_t i = 0; i < kMaxErrors; i++) {
+        const ErrorSlot& slot = store.errors[i];
+        if (slot.state.load(std::memory_order_acquire) != Used || slot.plugin >= kMaxPlugins || slot.operation >= kOperationCount) {
+            continue;
+        }
+        fprintf(output, "pluginactivator_call_failures_total{%s,operation=\"%s\",code=\"%s\"} %llu\n", labels[slot.plugin].c_str(),
+            kOperations[slot.operation], Core::ErrorToString(slot.code), static_cast<unsigned long long>(slot.count.load(std::memory_order_relaxed)));
+    }
+
+    fprintf(output, "# HELP pluginactivator_retries_total Waits before retrying a failed call\n");
+    fprintf(output, "# TYPE pluginactivator_retries_total counter\n");
+    for (size_t i : plugins) {
+        fprintf(output, "pluginactivator_retries_total{%s} %llu\n", labels[i].c_str(), static_cast<unsigned long long>(store.plugins[i].retries.load(std::memory_order_relaxed)));
+    }
+
+    fprintf(output, "# HELP pluginactivator_given_up_total Operations on the plugin that were given up on\n");
+    fprintf(output, "# TYPE pluginactivator_given_up_total counter\n");
+    for (size_t i : plugins) {
+        fprintf(output, "pluginactivator_given_up_total{%s} %llu\n", labels[i].c_str(), static_cast<unsigned long long>(store.plugins[i].givenUp.load(std::memory_order_relaxed)));
+    }
+
+    fprintf(output, "# HELP pluginactivator_call_duration_seconds Duration of each activate/deactivate call\n");
+    fprintf(output, "# TYPE pluginactivator_call_duration_seconds histogram\n");
+    for (size_t i : plugins) {
+        for (uint32_t operation = 0; operation < kOperationCount; operation++) {
+            printHistogram(output, "pluginactivator_call_duration_seconds", labels[i] + ",operation=\"" + kOperations[operation] + "\"", store.plugins[i].calls[operation]);
+        }
+    }
+
+    fprintf(output, "# HELP pluginactivator_activation_duration_seconds Time to activate the plugin, including retries\n");
+    fprintf(output, "# TYPE pluginactivator_activation_duration_seconds histogram\n");
+    for (size_t i : plugins) {
+        printHistogram(output, "pluginactivator_activation_duration_seconds", labels[i], store.plugins[i].activation);
+    }
+
+    fprintf(output, "# HELP pluginactivator_connect_duration_seconds Time to open the connection to Thunder\n");
+    fprintf(output, "# TYPE pluginactivator_connect_duration_seconds histogram\n");
+    printHistogram(output, "pluginactivator_connect_duration_seconds", std::string(), store.connect);
+
+    fprintf(output, "# HELP pluginactivator_connect_failures_total Failed attempts to connect to Thunder\n");
+    fprintf(output, "# TYPE pluginactivator_connect_failures_total counter\n");
+    fprintf(output, "pluginactivator_connect_failures_total %llu\n", static_cast<unsigned long long>(store.connectFailures.load(std::memory_order_relaxed)));
+
+    fprintf(output, "# HELP pluginactivator_metrics_dropped_total Updates lost because the metrics file was full\n");
+    fprintf(output, "# TYPE pluginactivator_metrics_dropped_total counter\n");
+    fprintf(output, "pluginactivator_metrics_dropped_total %llu\n", static_cast<unsigned long long>(store.dropped.load(std::memory_order_relaxed)));
+}
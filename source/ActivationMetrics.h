@@ -0,0 +1,76 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+/**
+ * @brief Counters and latency histograms shared by every activator on the box, across runs
+ *
+ * The metrics live in a fixed size file that each activator maps into memory. All updates are atomic
+ * operations on the shared mapping, so any number of activator processes (and their workers) can record
+ * at the same time without locks, and the totals survive until the file is removed. Put the file on a
+ * tmpfs to aggregate a single boot or on persistent storage to aggregate across boots.
+ *
+ * Recorded per plugin:
+ *  - Activate/deactivate calls made, how long they took and which errors they failed with
+ *  - Retries and plugins given up on
+ *  - Total time to activate, including retries
+ *
+ * plus how long it took to connect to Thunder. exportPrometheus() writes everything out in the Prometheus
+ * text format, for example for the node-exporter textfile collector
+ */
+class ActivationMetrics {
+public:
+    static ActivationMetrics& instance();
+
+    bool open(const std::string& path);
+    bool enabled() const { return _store != nullptr; }
+
+    void record(const char* phase, const std::string& callsign, const uint64_t durationUs, const uint32_t result);
+    void recordActivation(const std::string& callsign, const uint64_t durationUs);
+
+    void exportPrometheus(FILE* output) const;
+
+private:
+    struct Store;
+
+private:
+    ActivationMetrics();
+    ~ActivationMetrics();
+
+    ActivationMetrics(const ActivationMetrics&) = delete;
+    ActivationMetrics& operator=(const ActivationMetrics&) = delete;
+
+    int32_t plugin(const std::string& callsign);
+    void countError(const int32_t plugin, const uint32_t operation, const uint32_t code);
+
+private:
+    Store* _store;
+
+    // Slots already looked up by this process
+    std::mutex _lock;
+    std::map<std::string, int32_t> _slots;
+};
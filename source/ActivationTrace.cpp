@@ -0,0 +1,220 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ActivationTrace.h"
+
+#include "ActivationMetrics.h"
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint32_t threadId()
+{
+    static thread_local uint32_t tid = static_cast<uint32_t>(syscall(SYS_gettid));
+    return tid;
+}
+
+/**
+ * @brief Escape a string for inclusion in a JSON string literal
+ */
+static std::string escape(const std::string& value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned int>(c));
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+/**
+ * @brief Whether anything consumes the phase timings, so scopes cost nothing otherwise
+ */
+static bool timingPhases()
+{
+    return ActivationTrace::instance().enabled() || ActivationMetrics::instance().enabled() || LEVEL_DEBUG <= gActivatorLogLevel;
+}
+
+ActivationTrace::Scope::Scope(const char* phase, const std::string& callsign, const uint32_t attempt)
+    : _phase(phase)
+    , _callsign(timingPhases() ? callsign : std::string())
+    , _attempt(attempt)
+    , _start(timingPhases() ? ActivationTrace::now() : 0)
+    , _result(0)
+    , _enabled(timingPhases())
+{
+}
+
+ActivationTrace::Scope::~Scope()
+{
+    if (_enabled) {
+        const uint64_t durationUs = ActivationTrace::now() - _start;
+
+        ActivationTrace::instance().record(_phase, _callsign, _attempt, _start, durationUs, _result);
+        ActivationMetrics::instance().record(_phase, _callsign, durationUs, _result);
+    }
+}
+
+ActivationTrace::ActivationTrace()
+    : _enabled(false)
+    , _path()
+    , _format(Format::Chrome)
+    , _lock()
+    , _events()
+{
+}
+
+ActivationTrace& ActivationTrace::instance()
+{
+    static ActivationTrace trace;
+    return trace;
+}
+
+/**
+ * @brief Start recording, events will be appended to the given file on flush()
+ */
+bool ActivationTrace::open(const std::string& path, const Format format)
+{
+    // Make sure we can write to the file up front rather than finding out at the end of the run
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Trace", "Cannot open trace file %s (%s)", path.c_str(), strerror(errno));
+        return false;
+    }
+    close(fd);
+
+    _path = path;
+    _format = format;
+    _enabled = true;
+
+    return true;
+}
+
+/**
+ * @return Current CLOCK_MONOTONIC time in microseconds
+ */
+uint64_t ActivationTrace::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool ActivationTrace::parseFormat(const char* name, Format& format)
+{
+    if (strcmp(name, "json") == 0) {
+        format = Format::Json;
+    } else if (strcmp(name, "chrome") == 0) {
+        format = Format::Chrome;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void ActivationTrace::record(const char* phase, const std::string& callsign, const uint32_t attempt, const uint64_t startUs, const uint64_t durationUs, const uint32_t result)
+{
+    // Phases are logged at debug level whether or not a trace file is written
+    LOG_PHASE(callsign.c_str(), phase, durationUs, result);
+
+    if (!_enabled) {
+        return;
+    }
+
+    char event[512];
+
+    if (_format == Format::Chrome) {
+        snprintf(event, sizeof(event),
+            "{\"name\":\"%s\",\"cat\":\"PluginActivator\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%u,"
+            "\"args\":{\"callsign\":\"%s\",\"attempt\":%u,\"result\":%u}},\n",
+            phase, static_cast<unsigned long long>(startUs), static_cast<unsigned long long>(durationUs), getpid(), threadId(),
+            escape(callsign).c_str(), attempt, result);
+    } else {
+        snprintf(event, sizeof(event),
+            "{\"phase\":\"%s\",\"callsign\":\"%s\",\"attempt\":%u,\"start_us\":%llu,\"duration_us\":%llu,\"result\":%u,\"pid\":%d,\"tid\":%u}\n",
+            phase, escape(callsign).c_str(), attempt, static_cast<unsigned long long>(startUs), static_cast<unsigned long long>(durationUs), result,
+            getpid(), threadId());
+    }
+
+    std::lock_guard<std::mutex> lock(_lock);
+    _events.emplace_back(event);
+}
+
+/**
+ * @brief Append all buffered events to the trace file
+ *
+ * The file is locked while writing so that activators running at the same time don't interleave
+ * their events. The Chrome format is written as an unterminated JSON array, which the trace viewers
+ * accept, so that any number of processes can keep appending to it
+ */
+void ActivationTrace::flush()
+{
+    std::vector<std::string> events;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        events.swap(_events);
+    }
+
+    if (!_enabled || events.empty()) {
+        return;
+    }
+
+    int fd = ::open(_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Trace", "Cannot open trace file %s (%s)", _path.c_str(), strerror(errno));
+        return;
+    }
+
+    flock(fd, LOCK_EX);
+
+    std::string buffer;
+    struct stat status;
+    if (_format == Format::Chrome && fstat(fd, &status) == 0 && status.st_size == 0) {
+        buffer = "[\n";
+    }
+
+    for (const std::string& event : events) {
+        buffer += event;
+    }
+
+    if (write(fd, buffer.c_str(), buffer.size()) != static_cast<ssize_t>(buffer.size())) {
+        LOG_ERROR("Trace", "Failed to write trace file %s (%s)", _path.c_str(), strerror(errno));
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
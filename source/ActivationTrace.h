@@ -0,0 +1,95 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Records how long each phase of an activation takes
+ *
+ * Phases are timed against CLOCK_MONOTONIC, which is shared by every process on the box, so traces from
+ * all the activators started during boot can be appended to the same file and loaded into one timeline.
+ *
+ * Two output formats are supported:
+ *  - json:     One JSON object per line (JSON lines) with the phase, callsign, start, duration and result
+ *  - chrome:   Chrome trace-event format, which can be loaded into chrome://tracing or Perfetto
+ *
+ * Events are buffered in memory and appended to the file (under an flock) when flush() is called
+ */
+class ActivationTrace {
+public:
+    enum class Format {
+        Json,
+        Chrome
+    };
+
+    /**
+     * @brief Times a phase from construction to destruction
+     */
+    class Scope {
+    public:
+        Scope(const char* phase, const std::string& callsign, const uint32_t attempt = 0);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        void result(const uint32_t result) { _result = result; }
+
+    private:
+        const char* _phase;
+        const std::string _callsign;
+        const uint32_t _attempt;
+        const uint64_t _start;
+        uint32_t _result;
+        const bool _enabled;
+    };
+
+public:
+    static ActivationTrace& instance();
+
+    bool open(const std::string& path, const Format format);
+    bool enabled() const { return _enabled; }
+
+    void record(const char* phase, const std::string& callsign, const uint32_t attempt, const uint64_t startUs, const uint64_t durationUs, const uint32_t result);
+    void flush();
+
+    static uint64_t now();
+    static bool parseFormat(const char* name, Format& format);
+
+private:
+    ActivationTrace();
+    ~ActivationTrace() = default;
+
+    ActivationTrace(const ActivationTrace&) = delete;
+    ActivationTrace& operator=(const ActivationTrace&) = delete;
+
+private:
+    std::atomic<bool> _enabled;
+    std::string _path;
+    Format _format;
+
+    std::mutex _lock;
+    std::vector<std::string> _events;
+};
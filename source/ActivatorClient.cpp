@@ -0,0 +1,100 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ActivatorClient.h"
+
+#include "Log.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+ActivatorClient::ActivatorClient(const std::string& socketPath)
+    : _socketPath(socketPath)
+    , _fd(-1)
+    , _pending()
+{
+}
+
+ActivatorClient::~ActivatorClient()
+{
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool ActivatorClient::connect()
+{
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (_socketPath.size() >= sizeof(address.sun_path)) {
+        LOG_ERROR("Client", "Socket path %s is too long", _socketPath.c_str());
+        return false;
+    }
+    strncpy(address.sun_path, _socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    _fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_fd < 0) {
+        LOG_ERROR("Client", "Failed to create socket (%s)", strerror(errno));
+        return false;
+    }
+
+    if (::connect(_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        LOG_ERROR("Client", "Failed to connect to activator daemon at %s (%s)", _socketPath.c_str(), strerror(errno));
+        close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Send a single request line and wait for its response line
+ *
+ * @return False if the daemon could not be reached or closed the connection
+ */
+bool ActivatorClient::request(const std::string& request, std::string& response)
+{
+    const std::string line = request + "\n";
+
+    if (send(_fd, line.c_str(), line.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(line.size())) {
+        LOG_ERROR("Client", "Failed to send request (%s)", strerror(errno));
+        return false;
+    }
+
+    size_t end;
+    while ((end = _pending.find('\n')) == std::string::npos) {
+        char buffer[256];
+        ssize_t length = read(_fd, buffer, sizeof(buffer));
+
+        if (length <= 0) {
+            LOG_ERROR("Client", "Activator daemon closed the connection");
+            return false;
+        }
+        _pending.append(buffer, length);
+    }
+
+    response = _pending.substr(0, end);
+    _pending.erase(0, end + 1);
+
+    return true;
+}
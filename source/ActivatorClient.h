@@ -0,0 +1,44 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+
+/**
+ * @brief Forwards requests to a resident ActivatorDaemon over its unix domain socket
+ *
+ * Does not need a connection to Thunder itself, so it is cheap to start
+ */
+class ActivatorClient {
+public:
+    explicit ActivatorClient(const std::string& socketPath);
+    ~ActivatorClient();
+
+    ActivatorClient(const ActivatorClient&) = delete;
+    ActivatorClient& operator=(const ActivatorClient&) = delete;
+
+    bool connect();
+    bool request(const std::string& request, std::string& response);
+
+private:
+    const std::string _socketPath;
+    int _fd;
+    std::string _pending;
+};
@@ -0,0 +1,423 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ActivatorDaemon.h"
+
+#include "ActivationHistory.h"
+#include "AdmissionControl.h"
+#include "ActivationTrace.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// First file descriptor passed in by systemd socket activation (see sd_listen_fds(3))
+static constexpr int kSystemdListenFdStart = 3;
+
+// Longest request line we accept, a callsign plus a command easily fits
+static constexpr size_t kMaxRequestLength = 512;
+
+ActivatorDaemon::ActivatorDaemon(const ActivationEngine::StarterFactory& factory, const uint8_t maxStarters, const RetryPolicy& policy)
+    : _factory(factory)
+    , _maxStarters(std::max<uint8_t>(maxStarters, 1))
+    , _policy(policy)
+    , _listenFd(-1)
+    , _stopFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+    , _ownsSocket(false)
+    , _socketPath()
+    , _lock()
+    , _starterAvailable()
+    , _idleStarters()
+    , _starters(0)
+    , _states()
+    , _requests(0)
+    , _clients()
+{
+}
+
+ActivatorDaemon::~ActivatorDaemon()
+{
+    reapClients(true);
+
+    if (_listenFd >= 0) {
+        close(_listenFd);
+    }
+    if (_ownsSocket) {
+        unlink(_socketPath.c_str());
+    }
+    if (_stopFd >= 0) {
+        close(_stopFd);
+    }
+}
+
+const char* ActivatorDaemon::defaultSocketPath()
+{
+    return "/run/PluginActivator";
+}
+
+/**
+ * @brief Whether an activator daemon is already serving requests on the socket path
+ */
+static bool socketInUse(const struct sockaddr_un& address)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    const bool listening = (connect(fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) == 0);
+    close(fd);
+
+    return listening;
+}
+
+/**
+ * @brief Only the daemon's own user (and root) may send it requests
+ *
+ * The socket we bind ourselves is already restricted to its owner, this also covers a socket passed in by
+ * systemd with a more permissive SocketMode
+ */
+static bool peerAllowed(const int fd)
+{
+    struct ucred credentials = {};
+    socklen_t length = sizeof(credentials);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+        LOG_WARN("Daemon", "Cannot identify client (%s)", strerror(errno));
+        return false;
+    }
+
+    if (credentials.uid != 0 && credentials.uid != geteuid()) {
+        LOG_WARN("Daemon", "Rejecting client pid %d running as uid %u", static_cast<int>(credentials.pid), static_cast<uint32_t>(credentials.uid));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Start listening for requests
+ *
+ * Uses the socket passed in by systemd if there is one, otherwise binds to the given path
+ *
+ * @return False if no listening socket could be set up
+ */
+bool ActivatorDaemon::open(const std::string& socketPath)
+{
+    const char* listenPid = getenv("LISTEN_PID");
+    const char* listenFds = getenv("LISTEN_FDS");
+
+    if (listenPid != nullptr && listenFds != nullptr && atoi(listenPid) == getpid() && atoi(listenFds) >= 1) {
+        LOG_INF("Daemon", "Using socket passed in by systemd");
+        _listenFd = kSystemdListenFdStart;
+        fcntl(_listenFd, F_SETFD, FD_CLOEXEC);
+
+        unsetenv("LISTEN_PID");
+        unsetenv("LISTEN_FDS");
+        unsetenv("LISTEN_FDNAMES");
+        return true;
+    }
+
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        LOG_ERROR("Daemon", "Socket path %s is too long", socketPath.c_str());
+        return false;
+    }
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    _listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_listenFd < 0) {
+        LOG_ERROR("Daemon", "Failed to create socket (%s)", strerror(errno));
+        return false;
+    }
+
+    // Clean up after a previous instance that did not shut down cleanly, but never take over from one that is
+    // still running or remove something that isn't a socket
+    struct stat existing;
+    if (lstat(socketPath.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            LOG_ERROR("Daemon", "%s exists and is not a socket", socketPath.c_str());
+            close(_listenFd);
+            _listenFd = -1;
+            return false;
+        }
+        if (socketInUse(address)) {
+            LOG_ERROR("Daemon", "Another activator daemon is already listening on %s", socketPath.c_str());
+            close(_listenFd);
+            _listenFd = -1;
+            return false;
+        }
+        unlink(socketPath.c_str());
+    }
+
+    // Create the socket accessible to our own user only, requests can deactivate any plugin
+    const mode_t mask = umask(0177);
+    const bool bound = (bind(_listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0);
+    umask(mask);
+
+    if (!bound || listen(_listenFd, SOMAXCONN) != 0) {
+        LOG_ERROR("Daemon", "Failed to listen on %s (%s)", socketPath.c_str(), strerror(errno));
+        if (bound) {
+            unlink(socketPath.c_str());
+        }
+        close(_listenFd);
+        _listenFd = -1;
+        return false;
+    }
+
+    _ownsSocket = true;
+    _socketPath = socketPath;
+    LOG_INF("Daemon", "Listening on %s", socketPath.c_str());
+
+    return true;
+}
+
+/**
+ * @brief Accept and serve clients until stop() is called
+ */
+void ActivatorDaemon::run()
+{
+    struct pollfd fds[2] = {
+        { _listenFd, POLLIN, 0 },
+        { _stopFd, POLLIN, 0 }
+    };
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Daemon", "poll failed (%s)", strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents != 0) {
+            LOG_INF("Daemon", "Shutting down");
+            break;
+        }
+
+        if ((fds[0].revents & POLLIN) != 0) {
+            int fd = accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+
+            if (!peerAllowed(fd)) {
+                close(fd);
+                continue;
+            }
+
+            reapClients(false);
+
+            _clients.emplace_back();
+            Client& client = _clients.back();
+            client.fd = fd;
+            client.done = false;
+            client.thread = std::thread(&ActivatorDaemon::serve, this, std::ref(client));
+        }
+    }
+}
+
+/**
+ * @brief Ask the daemon to stop, safe to call from a signal handler
+ */
+void ActivatorDaemon::stop()
+{
+    const uint64_t value = 1;
+    ssize_t written = write(_stopFd, &value, sizeof(value));
+    (void)written;
+}
+
+/**
+ * @brief Join finished client threads, or all of them when shutting down
+ */
+void ActivatorDaemon::reapClients(const bool all)
+{
+    auto it = _clients.begin();
+    while (it != _clients.end()) {
+        if (all || it->done) {
+            if (!it->done) {
+                // Unblock the read, an in-progress request is allowed to complete
+                shutdown(it->fd, SHUT_RD);
+            }
+            it->thread.join();
+            close(it->fd);
+            it = _clients.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ActivatorDaemon::serve(Client& client)
+{
+    std::string pending;
+    char buffer[256];
+    bool connected = true;
+
+    while (connected) {
+        ssize_t length = read(client.fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        pending.append(buffer, length);
+
+        size_t end;
+        while (connected && (end = pending.find('\n')) != std::string::npos) {
+            const std::string request = pending.substr(0, end);
+            pending.erase(0, end + 1);
+
+            const std::string response = handle(request) + "\n";
+            connected = (send(client.fd, response.c_str(), response.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(response.size()));
+        }
+
+        if (pending.size() > kMaxRequestLength) {
+            LOG_WARN("Daemon", "Dropping client sending oversized request");
+            break;
+        }
+    }
+
+    client.done = true;
+}
+
+std::string ActivatorDaemon::handle(const std::string& request)
+{
+    std::istringstream tokens(request);
+    std::string command;
+    std::string callsign;
+
+    tokens >> command >> callsign;
+    LOG_DBG("Daemon", "Request: %s %s", command.c_str(), callsign.c_str());
+
+    if (command == "status") {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        if (callsign.empty()) {
+            std::ostringstream response;
+            response << "OK requests=" << _requests << " starters=" << static_cast<uint32_t>(_starters) << " plugins=" << _states.size();
+            return response.str();
+        }
+
+        auto state = _states.find(callsign);
+        return "OK " + callsign + " " + ((state != _states.end()) ? state->second : "unknown");
+    }
+
+    IPluginStarter::Operation operation;
+    if (!IPluginStarter::parseOperation(command, operation)) {
+        return "ERROR unknown command";
+    }
+    if (callsign.empty()) {
+        return "ERROR missing callsign";
+    }
+
+    // Fit the retry policy to the plugin if we've seen it activate before
+    RetryPolicy policy = _policy;
+    ActivationHistory::Estimate estimate;
+    if (operation == IPluginStarter::Operation::Activate && ActivationHistory::instance().estimate(callsign, estimate)) {
+        policy = ActivationHistory::adapt(_policy, estimate);
+    }
+
+    std::unique_ptr<IPluginStarter> starter = acquireStarter(operation);
+
+    const bool success = starter->execute(callsign, operation, policy);
+
+    releaseStarter(std::move(starter));
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _requests++;
+        _states[callsign] = success ? (command + "d") : "failed";
+    }
+
+    // The daemon never exits during boot, so write out the trace and history as we go
+    ActivationTrace::instance().flush();
+    ActivationHistory::instance().save();
+
+    return success ? "OK" : ("ERROR failed to " + command + " " + callsign);
+}
+
+/**
+ * @brief Borrow an idle starter, creating one if the limit has not been reached
+ *
+ * Blocks until a starter becomes available. While the system is under pressure, activating and resuming
+ * also wait for every other request in progress to finish
+ */
+std::unique_ptr<IPluginStarter> ActivatorDaemon::acquireStarter(const IPluginStarter::Operation operation)
+{
+    const bool addsLoad = (operation == IPluginStarter::Operation::Activate || operation == IPluginStarter::Operation::Resume);
+
+    std::unique_lock<std::mutex> lock(_lock);
+
+    while (true) {
+        if (_idleStarters.empty() && _starters >= _maxStarters) {
+            _starterAvailable.wait(lock);
+            continue;
+        }
+
+        const size_t busy = _starters - _idleStarters.size();
+        if (addsLoad && busy > 0) {
+            // Sampling reads /proc, so it is done without the lock to not hold up the other requests
+            lock.unlock();
+            const bool overloaded = AdmissionControl::instance().overloaded();
+            lock.lock();
+
+            if (overloaded) {
+                _starterAvailable.wait_for(lock, std::chrono::milliseconds(AdmissionControl::pollIntervalMs()));
+                continue;
+            }
+
+            // Another request may have taken the last starter in the meantime
+            if (_idleStarters.empty() && _starters >= _maxStarters) {
+                continue;
+            }
+        }
+
+        break;
+    }
+
+    if (!_idleStarters.empty()) {
+        std::unique_ptr<IPluginStarter> starter = std::move(_idleStarters.back());
+        _idleStarters.pop_back();
+        return starter;
+    }
+
+    _starters++;
+    lock.unlock();
+
+    return _factory();
+}
+
+void ActivatorDaemon::releaseStarter(std::unique_ptr<IPluginStarter> starter)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    _idleStarters.push_back(std::move(starter));
+    _starterAvailable.notify_one();
+}
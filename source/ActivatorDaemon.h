@@ -0,0 +1,106 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ActivationEngine.h"
+#include "RetryPolicy.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Resident activator that serves requests over a unix domain socket
+ *
+ * Keeps its starters (and so their controller connections) warm between requests, so activating a plugin
+ * costs a few bytes over a local socket instead of a new process and a new Thunder connection.
+ *
+ * Supports systemd socket activation - if started with a listening socket passed in by systemd that
+ * socket is used, otherwise the daemon creates and binds its own, readable and writable by its owner only.
+ * Either way only clients running as root or as the daemon's user are served, and the daemon refuses to
+ * start if another one is already listening on its path.
+ *
+ * The protocol is line based, one request per line and one response line per request:
+ *
+ *      activate <callsign>         ->  OK | ERROR <reason>
+ *      deactivate <callsign>       ->  OK | ERROR <reason>
+ *      hibernate <callsign>        ->  OK | ERROR <reason>
+ *      resume <callsign>           ->  OK | ERROR <reason>
+ *      status [<callsign>]         ->  OK <details> | ERROR <reason>
+ *
+ * Requests on one connection are handled in order, separate connections are handled concurrently
+ * (limited by the number of starters, and to one activation at a time while the system is under pressure)
+ */
+class ActivatorDaemon {
+public:
+    ActivatorDaemon(const ActivationEngine::StarterFactory& factory, const uint8_t maxStarters, const RetryPolicy& policy);
+    ~ActivatorDaemon();
+
+    ActivatorDaemon(const ActivatorDaemon&) = delete;
+    ActivatorDaemon& operator=(const ActivatorDaemon&) = delete;
+
+    bool open(const std::string& socketPath);
+    void run();
+    void stop();
+
+    static const char* defaultSocketPath();
+
+private:
+    struct Client {
+        int fd;
+        std::thread thread;
+        std::atomic<bool> done;
+    };
+
+private:
+    void serve(Client& client);
+    std::string handle(const std::string& request);
+
+    std::unique_ptr<IPluginStarter> acquireStarter(const IPluginStarter::Operation operation);
+    void releaseStarter(std::unique_ptr<IPluginStarter> starter);
+
+    void reapClients(const bool all);
+
+private:
+    const ActivationEngine::StarterFactory _factory;
+    const uint8_t _maxStarters;
+    const RetryPolicy _policy;
+
+    int _listenFd;
+    int _stopFd;
+    bool _ownsSocket;
+    std::string _socketPath;
+
+    std::mutex _lock;
+    std::condition_variable _starterAvailable;
+    std::vector<std::unique_ptr<IPluginStarter>> _idleStarters;
+    uint8_t _starters;
+
+    std::map<std::string, std::string> _states;
+    uint32_t _requests;
+
+    std::list<Client> _clients;
+};
@@ -0,0 +1,212 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AdmissionControl.h"
+
+#include "Log.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+
+// How long a reading is reused for, and how often held back activations check again
+static constexpr uint32_t kSampleIntervalMs = 100;
+static constexpr uint32_t kPollIntervalMs = 200;
+
+AdmissionControl::AdmissionControl()
+    : _limits()
+    , _enabled(false)
+    , _lock()
+    , _sampled()
+    , _overloaded(false)
+    , _warnedNoPressure(false)
+{
+}
+
+AdmissionControl& AdmissionControl::instance()
+{
+    static AdmissionControl admission;
+    return admission;
+}
+
+/**
+ * @brief Set the limits, must be called before any activations are started
+ */
+void AdmissionControl::configure(const Limits& limits)
+{
+    _limits = limits;
+    _enabled = (limits.minAvailableKb != 0 || limits.maxMemoryPressure > 0 || limits.maxCpuPressure > 0 || limits.maxIoPressure > 0);
+}
+
+uint32_t AdmissionControl::pollIntervalMs()
+{
+    return kPollIntervalMs;
+}
+
+/**
+ * @brief Whether any of the limits is currently exceeded
+ *
+ * Logs when the system becomes overloaded and when it recovers
+ */
+bool AdmissionControl::overloaded()
+{
+    if (!_enabled) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_lock);
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - _sampled < std::chrono::milliseconds(kSampleIntervalMs)) {
+        return _overloaded;
+    }
+    _sampled = now;
+
+    std::string reason;
+    const bool overloaded = sample(reason);
+
+    if (overloaded && !_overloaded) {
+        LOG_INF("Admission", "Holding back activations - %s", reason.c_str());
+    } else if (!overloaded && _overloaded) {
+        LOG_INF("Admission", "Pressure has dropped, releasing activations");
+    }
+
+    _overloaded = overloaded;
+    return _overloaded;
+}
+
+/**
+ * @brief Read the current figures and compare them with the limits
+ *
+ * @param[out]  reason  Which limit is exceeded
+ */
+bool AdmissionControl::sample(std::string& reason)
+{
+    std::ostringstream message;
+
+    if (_limits.minAvailableKb != 0) {
+        std::ifstream meminfo("/proc/meminfo");
+        std::string key;
+        uint64_t value;
+        std::string unit;
+
+        while (meminfo >> key >> value >> unit) {
+            if (key == "MemAvailable:") {
+                if (value < _limits.minAvailableKb) {
+                    message << "only " << value / 1024 << "MB available, below " << _limits.minAvailableKb / 1024 << "MB";
+                    reason = message.str();
+                    return true;
+                }
+                break;
+            }
+        }
+    }
+
+    const struct {
+        const char* resource;
+        double limit;
+    } pressures[] = {
+        { "memory", _limits.maxMemoryPressure },
+        { "cpu", _limits.maxCpuPressure },
+        { "io", _limits.maxIoPressure }
+    };
+
+    for (const auto& entry : pressures) {
+        double avg10;
+
+        if (entry.limit > 0 && pressure(entry.resource, avg10) && avg10 > entry.limit) {
+            message << entry.resource << " pressure " << avg10 << "% above " << entry.limit << "%";
+            reason = message.str();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Read the share of time some tasks were stalled on the resource over the last 10s
+ *
+ * @return False if the kernel doesn't provide pressure stall information
+ */
+bool AdmissionControl::pressure(const char* resource, double& avg10)
+{
+    std::ifstream file(std::string("/proc/pressure/") + resource);
+    std::string line;
+
+    // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    while (std::getline(file, line)) {
+        const size_t position = line.find("avg10=");
+
+        if (line.compare(0, 5, "some ") == 0 && position != std::string::npos) {
+            avg10 = strtod(line.c_str() + position + 6, nullptr);
+            return true;
+        }
+    }
+
+    if (!_warnedNoPressure) {
+        LOG_WARN("Admission", "No pressure stall information for %s, ignoring its limit (kernel without CONFIG_PSI?)", resource);
+        _warnedNoPressure = true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Parse limits of the form <name>=<value>[,<name>=<value>...]
+ *
+ * Names are available (MB of MemAvailable to keep free) and memory, cpu and io (maximum pressure in %)
+ *
+ * @return False if the argument is malformed
+ */
+bool AdmissionControl::parseLimits(const char* argument, Limits& limits)
+{
+    std::istringstream entries(argument);
+    std::string entry;
+
+    while (std::getline(entries, entry, ',')) {
+        const size_t separator = entry.find('=');
+        if (separator == std::string::npos) {
+            return false;
+        }
+
+        const std::string name = entry.substr(0, separator);
+        const char* value = entry.c_str() + separator + 1;
+        char* end = nullptr;
+        const double number = strtod(value, &end);
+
+        if (end == value || *end != '\0' || number < 0) {
+            return false;
+        }
+
+        if (name == "available") {
+            limits.minAvailableKb = static_cast<uint64_t>(number * 1024);
+        } else if (name == "memory") {
+            limits.maxMemoryPressure = number;
+        } else if (name == "cpu") {
+            limits.maxCpuPressure = number;
+        } else if (name == "io") {
+            limits.maxIoPressure = number;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
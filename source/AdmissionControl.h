@@ -0,0 +1,85 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+/**
+ * @brief Holds back new activations while the system is under memory, CPU or I/O pressure
+ *
+ * Reads MemAvailable from /proc/meminfo and the "some avg10" pressure stall figures from
+ * /proc/pressure/{memory,cpu,io} and compares them against the configured limits. Callers only ask while
+ * they already have activations in flight, so at least one plugin always makes progress: under pressure
+ * activations are started one after another instead of all at once, and the parallelism comes back as the
+ * pressure drops.
+ *
+ * Readings are cached briefly, so any number of workers can ask without hitting /proc every time
+ */
+class AdmissionControl {
+public:
+    struct Limits {
+        Limits()
+            : minAvailableKb(0)
+            , maxMemoryPressure(0)
+            , maxCpuPressure(0)
+            , maxIoPressure(0)
+        {
+        }
+
+        // 0 disables the limit. Pressures are the percentage of time stalled over the last 10s
+        uint64_t minAvailableKb;
+        double maxMemoryPressure;
+        double maxCpuPressure;
+        double maxIoPressure;
+    };
+
+public:
+    static AdmissionControl& instance();
+
+    void configure(const Limits& limits);
+    bool enabled() const { return _enabled; }
+
+    bool overloaded();
+
+    static bool parseLimits(const char* argument, Limits& limits);
+    static uint32_t pollIntervalMs();
+
+private:
+    AdmissionControl();
+    ~AdmissionControl() = default;
+
+    AdmissionControl(const AdmissionControl&) = delete;
+    AdmissionControl& operator=(const AdmissionControl&) = delete;
+
+    bool sample(std::string& reason);
+    bool pressure(const char* resource, double& avg10);
+
+private:
+    Limits _limits;
+    bool _enabled;
+
+    std::mutex _lock;
+    std::chrono::steady_clock::time_point _sampled;
+    bool _overloaded;
+    bool _warnedNoPressure;
+};
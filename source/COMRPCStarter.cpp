@@ -19,140 +19,659 @@
 
 #include "COMRPCStarter.h"
 
+#include "ActivationHistory.h"
+#include "ActivationMetrics.h"
+#include "ActivationTrace.h"
 #include "Log.h"
+#include "ProcessDiscovery.h"
+#include "StateBoard.h"
 
+#include <algorithm>
 #include <chrono>
+#include <set>
 #include <thread>
 
-COMRPCStarter::COMRPCStarter(const string& pluginName)
+// How long Thunder is given to hibernate a plugin's process, unless the call timeout is shorter
+static constexpr uint32_t kHibernateTimeoutMs = 10000;
+
+// Shortest wait before an event-triggered retry, so a burst of plugins changing state together causes one retry, not one per plugin
+static constexpr uint32_t kMinEventRetryMs = 25;
+
+using Subsystems = std::set<PluginHost::ISubSystem::subsystem>;
+
+/**
+ * @brief The subsystems currently active
+ */
+static Subsystems activeSubsystems(Exchange::Controller::ISubsystems::ISubsystemsIterator* iterator)
+{
+    Subsystems active;
+    Exchange::Controller::ISubsystems::Subsystem entry;
+
+    while (iterator->Next(entry) == true) {
+        if (entry.Active == true) {
+            active.insert(entry.Subsystem);
+        }
+    }
+
+    return active;
+}
+
+/**
+ * @brief Which of the required subsystems are not in the required state
+ *
+ * Preconditions can also require a subsystem to be inactive (the NOT_ variants)
+ */
+static std::vector<PluginHost::ISubSystem::subsystem> unmetSubsystems(const std::vector<PluginHost::ISubSystem::subsystem>& required, const Subsystems& active)
+{
+    std::vector<PluginHost::ISubSystem::subsystem> unmet;
+
+    for (PluginHost::ISubSystem::subsystem subsystem : required) {
+        const uint32_t value = static_cast<uint32_t>(subsystem);
+        const bool negated = (value & PluginHost::ISubSystem::NEGATIVE_START) != 0;
+        const auto base = static_cast<PluginHost::ISubSystem::subsystem>(value & ~static_cast<uint32_t>(PluginHost::ISubSystem::NEGATIVE_START));
+
+        if ((active.count(base) != 0) == negated) {
+            unmet.push_back(subsystem);
+        }
+    }
+
+    return unmet;
+}
+
+static string subsystemNames(const std::vector<PluginHost::ISubSystem::subsystem>& subsystems)
+{
+    string names;
+
+    for (PluginHost::ISubSystem::subsystem subsystem : subsystems) {
+        const TCHAR* name = Core::EnumerateType<PluginHost::ISubSystem::subsystem>(subsystem).Data();
+
+        if (!names.empty()) {
+            names += ", ";
+        }
+        names += (name != nullptr) ? name : std::to_string(static_cast<uint32_t>(subsystem));
+    }
+
+    return names;
+}
+
+COMRPCStarter::COMRPCStarter(const uint32_t callTimeoutMs)
     : IPluginStarter()
-    , _connector()
-    , _pluginName(pluginName)
+    , _callTimeoutMs(callTimeoutMs)
+    , _watchdog()
+    , _connector(std::make_shared<ControllerConnector>())
+    , _notification(Core::ServiceType<Notification>::Create<Notification>(*this))
+    , _lifetimeEvents(nullptr)
+    , _subsystemEvents(nullptr)
+    , _eventLock()
+    , _eventSignal()
+    , _events(0)
+    , _currentCallsign()
+    , _awaitedSubsystems()
+{
+}
+
+COMRPCStarter::~COMRPCStarter()
 {
+    disconnect();
+
+    _notification->detach();
+    _notification->Release();
+}
+
+void COMRPCStarter::Notification::StateChange(const string& callsign, const PluginHost::IShell::state& state, const PluginHost::IShell::reason& reason VARIABLE_IS_NOT_USED)
+{
+    StateBoard::instance().publishState(callsign, state);
+
+    std::lock_guard<std::mutex> lock(_lock);
+
+    // Another plugin activating may be exactly what we were waiting on, changes to other states only
+    // matter for the plugin being worked on
+    if (_parent != nullptr) {
+        _parent->onControllerEvent(callsign, state == PluginHost::IShell::ACTIVATED);
+    }
+}
+
+void COMRPCStarter::Notification::SubsystemChange(Exchange::Controller::ISubsystems::ISubsystemsIterator* const subsystems)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    if (_parent != nullptr) {
+        _parent->onSubsystemChange(subsystems);
+    }
+}
+
+/**
+ * @brief Stop forwarding events to the starter
+ */
+void COMRPCStarter::Notification::detach()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _parent = nullptr;
 }
 
 /**
- * @brief Attempt to activate the plugin and automatically retry on failure
+ * @brief Get the ILifeTime interface, opening the controller connection if needed
  *
- * @param[in]   maxRetries      Maximum amount of times to retry activation if it fails
- * @param[in]   retryDelayMs    Delay in ms between retry attempts
+ * @return ILifeTime interface (must be released by the caller) or nullptr if Thunder could not be reached
+ */
+Exchange::Controller::ILifeTime* COMRPCStarter::controller(const string& callsign, const uint32_t attempt)
+{
+    if (_connector->IsOperational() == false) {
+        ActivationTrace::Scope trace("open", callsign, attempt);
+
+        uint32_t result = _connector->Open(RPC::CommunicationTimeOut, ControllerConnector::Connector());
+        if (result != Core::ERROR_NONE) {
+            LOG_ERROR(callsign.c_str(), "Failed to get controller interface, error %u (%s)", result, Core::ErrorToString(result));
+        }
+        trace.result(result);
+    }
+
+    Exchange::Controller::ILifeTime* lifetime;
+    {
+        ActivationTrace::Scope trace("interface", callsign, attempt);
+        lifetime = _connector->Interface();
+        trace.result(lifetime != nullptr ? Core::ERROR_NONE : Core::ERROR_UNAVAILABLE);
+    }
+
+    if (lifetime != nullptr && _lifetimeEvents == nullptr) {
+        ActivationTrace::Scope trace("register", callsign, attempt);
+        registerNotifications(lifetime);
+    }
+
+    return lifetime;
+}
+
+/**
+ * @brief Whether the plugin is currently hibernated, false if its state can't be read
+ */
+static bool hibernated(Exchange::Controller::ILifeTime* lifetime, const string& callsign)
+{
+    Exchange::Controller::IMetadata* metadata = lifetime->QueryInterface<Exchange::Controller::IMetadata>();
+    if (metadata == nullptr) {
+        return false;
+    }
+
+    bool result = false;
+
+    Exchange::Controller::IMetadata::Data::IServicesIterator* services = nullptr;
+    if (metadata->Services(callsign, services) == Core::ERROR_NONE && services != nullptr) {
+        Exchange::Controller::IMetadata::Data::Service service;
+        result = (services->Next(service) == true && service.State == PluginHost::IShell::HIBERNATED);
+        services->Release();
+    }
+    metadata->Release();
+
+    return result;
+}
+
+/**
+ * @brief Make the ILifeTime call(s) for the operation
  *
- * @return True if plugin successfully activated, false if failed to activate
+ * ILifeTime::Resume() only resumes a suspended plugin (IStateControl), a hibernated one is woken up by
+ * activating it. The state is looked up here, so the lookup runs under the same time limit as the call
  */
-bool COMRPCStarter::activatePlugin(const uint8_t maxRetries, const uint16_t retryDelayMs)
+static Core::hresult call(Exchange::Controller::ILifeTime* lifetime, const string& callsign, const IPluginStarter::Operation operation, const uint32_t hibernateTimeoutMs)
 {
-    // Attempt to open the plugin shell
-    bool success = false;
-    int currentRetry = 1;
+    switch (operation) {
+    case IPluginStarter::Operation::Activate:
+        return lifetime->Activate(callsign);
+    case IPluginStarter::Operation::Deactivate:
+        return lifetime->Deactivate(callsign);
+    case IPluginStarter::Operation::Hibernate:
+        return lifetime->Hibernate(callsign, hibernateTimeoutMs);
+    case IPluginStarter::Operation::Resume:
+        return hibernated(lifetime, callsign) ? lifetime->Activate(callsign) : lifetime->Resume(callsign);
+    }
+    return Core::ERROR_BAD_REQUEST;
+}
 
-    while (!success && currentRetry <= maxRetries) {
-        LOG_INF(_pluginName.c_str(), "Attempting to activate plugin - attempt %d/%d", currentRetry, maxRetries);
+/**
+ * @brief Whether the call failed because Thunder or the plugin can't do the operation at all, so retrying is pointless
+ *
+ * Hibernation is only available in Thunder builds with hibernate support, and only for out-of-process plugins.
+ * Other errors (e.g. ERROR_UNAVAILABLE while the plugin is changing state) are retried as usual
+ */
+static bool notSupported(const IPluginStarter::Operation operation, const Core::hresult result)
+{
+    if (operation != IPluginStarter::Operation::Hibernate && operation != IPluginStarter::Operation::Resume) {
+        return false;
+    }
+    return result == Core::ERROR_NOT_SUPPORTED;
+}
 
-        auto start = Core::Time::Now();
+/**
+ * @brief Make the call for the operation, under the watchdog if there is a time limit
+ *
+ * @param[in]   timeoutMs   Time limit for the call, 0 for none
+ * @param[out]  hung        Set if the call did not return within the time limit
+ */
+Core::hresult COMRPCStarter::invoke(Exchange::Controller::ILifeTime* lifetime, const string& callsign, const Operation operation, const uint32_t timeoutMs, bool& hung)
+{
+    const uint32_t hibernateTimeoutMs = (timeoutMs != 0) ? std::min(timeoutMs, kHibernateTimeoutMs) : kHibernateTimeoutMs;
 
-        if (_connector.IsOperational() == false) {
-            uint32_t result = _connector.Open(RPC::CommunicationTimeOut, ControllerConnector::Connector());
-            if (result != Core::ERROR_NONE) {
-                LOG_ERROR(_pluginName.c_str(), "Failed to get controller interface, error %u (%s)", result, Core::ErrorToString(result));
-            }
+    hung = false;
+
+    if (timeoutMs == 0) {
+        return call(lifetime, callsign, operation, hibernateTimeoutMs);
+    }
+
+    // The call holds its own reference, it may outlive this attempt
+    lifetime->AddRef();
+
+    uint32_t result = Core::ERROR_TIMEDOUT;
+    const bool returned = _watchdog.run([lifetime, callsign, operation, hibernateTimeoutMs]() {
+        const uint32_t outcome = call(lifetime, callsign, operation, hibernateTimeoutMs);
+        lifetime->Release();
+        return outcome;
+    },
+        timeoutMs, result);
+
+    if (!returned) {
+        hung = true;
+        abandonConnection();
+    }
+
+    return result;
+}
+
+/**
+ * @brief Leave the controller connection to a call that is stuck on it
+ *
+ * Nothing else can go over the connection until the call returns, so it is handed over to the watchdog
+ * to clean up if that ever happens and the next attempt opens a new one
+ */
+void COMRPCStarter::abandonConnection()
+{
+    std::shared_ptr<ControllerConnector> connector = _connector;
+    Exchange::Controller::ILifeTime* lifetimeEvents = _lifetimeEvents;
+    Exchange::Controller::ISubsystems* subsystemEvents = _subsystemEvents;
+    Notification* notification = _notification;
+
+    notification->detach();
+
+    _watchdog.abandon([connector, lifetimeEvents, subsystemEvents, notification]() {
+        if (subsystemEvents != nullptr) {
+            subsystemEvents->Unregister(notification);
+            subsystemEvents->Release();
+        }
+        if (lifetimeEvents != nullptr) {
+            lifetimeEvents->Unregister(notification);
+            lifetimeEvents->Release();
         }
+        if (connector->IsOperational() == true) {
+            connector->Close(RPC::CommunicationTimeOut);
+        }
+        notification->Release();
+    });
 
-        Exchange::Controller::ILifeTime* lifetime = _connector.Interface();
+    _connector = std::make_shared<ControllerConnector>();
+    _notification = Core::ServiceType<Notification>::Create<Notification>(*this);
+    _lifetimeEvents = nullptr;
+    _subsystemEvents = nullptr;
+}
 
-        if (lifetime == nullptr) {
-            LOG_ERROR(_pluginName.c_str(), "Failed to open ILifeTime interface, will retry after %dms", retryDelayMs);
-            currentRetry++;
+void COMRPCStarter::disconnect()
+{
+    unregisterNotifications();
 
-            _connector.Close(RPC::CommunicationTimeOut);
+    if (_connector->IsOperational() == true) {
+        ActivationTrace::Scope trace("close", _currentCallsign);
+        _connector->Close(RPC::CommunicationTimeOut);
+    }
+}
 
-            // Sleep, then try again
-            std::this_thread::sleep_for(std::chrono::milliseconds(retryDelayMs));
+/**
+ * @brief Subscribe to plugin state and subsystem changes so retries can be triggered by events
+ *
+ * Failing to subscribe is not fatal, we just fall back to retrying after the delay
+ */
+void COMRPCStarter::registerNotifications(Exchange::Controller::ILifeTime* lifetime)
+{
+    if (lifetime->Register(_notification) == Core::ERROR_NONE) {
+        _lifetimeEvents = lifetime;
+        _lifetimeEvents->AddRef();
+    } else {
+        LOG_WARN("Controller", "Failed to register for plugin state changes");
+    }
+
+    Exchange::Controller::ISubsystems* subsystems = lifetime->QueryInterface<Exchange::Controller::ISubsystems>();
+    if (subsystems != nullptr) {
+        if (subsystems->Register(_notification) == Core::ERROR_NONE) {
+            _subsystemEvents = subsystems;
         } else {
-            // Will block until plugin is activated
-            Core::hresult result = lifetime->Activate(_pluginName.c_str());
+            LOG_WARN("Controller", "Failed to register for subsystem changes");
+            subsystems->Release();
+        }
+    }
+}
 
-            auto duration = Core::Time::Now().Sub(start.MilliSeconds());
+void COMRPCStarter::unregisterNotifications()
+{
+    if (_subsystemEvents != nullptr) {
+        _subsystemEvents->Unregister(_notification);
+        _subsystemEvents->Release();
+        _subsystemEvents = nullptr;
+    }
 
-            if (result != Core::ERROR_NONE) {
-                if (result == Core::ERROR_PENDING_CONDITIONS) {
-                    // Ideally we'd print out which preconditions are un-met for debugging, but that data is not exposed through the IShell interface
-                    LOG_ERROR(_pluginName.c_str(), "Failed to activate plugin due to unmet preconditions after %dms", duration.MilliSeconds());
-                } else {
-                    LOG_ERROR(_pluginName.c_str(), "Failed to activate plugin with error %u (%s) after %dms", result, Core::ErrorToString(result), duration.MilliSeconds());
-                }
+    if (_lifetimeEvents != nullptr) {
+        _lifetimeEvents->Unregister(_notification);
+        _lifetimeEvents->Release();
+        _lifetimeEvents = nullptr;
+    }
+}
 
-                // Try activation again up until the max number of retries
-                currentRetry++;
-                std::this_thread::sleep_for(std::chrono::milliseconds(retryDelayMs));
-            } else {
-                // Our work here is done!
-                LOG_INF(_pluginName.c_str(), "Successfully activated plugin after %dms", duration.MilliSeconds());
-                success = true;
-            }
-            lifetime->Release();
+/**
+ * @brief Look up which of the plugin's preconditions are not met
+ *
+ * Reads the preconditions from the plugin's metadata and compares them with the subsystems that are
+ * currently active
+ *
+ * @return False if the controller doesn't expose the information
+ */
+bool COMRPCStarter::unmetPreconditions(Exchange::Controller::ILifeTime* lifetime, const string& callsign, std::vector<Subsystem>& unmet) const
+{
+    Exchange::Controller::IMetadata* metadata = lifetime->QueryInterface<Exchange::Controller::IMetadata>();
+    if (metadata == nullptr) {
+        return false;
+    }
+
+    string precondition;
+    bool found = false;
+
+    Exchange::Controller::IMetadata::Data::IServicesIterator* services = nullptr;
+    if (metadata->Services(callsign, services) == Core::ERROR_NONE && services != nullptr) {
+        Exchange::Controller::IMetadata::Data::Service service;
+        if (services->Next(service) == true) {
+            precondition = service.Precondition;
+            found = true;
         }
+        services->Release();
     }
+    metadata->Release();
 
-    if (!success) {
-        LOG_ERROR(_pluginName.c_str(), "Max retries hit - giving up activating the plugin");
+    if (found == false) {
+        return false;
     }
 
-    if (_connector.IsOperational() == true) {
-        _connector.Close(RPC::CommunicationTimeOut);
+    // Stored the same way as in the plugin configuration, a JSON array of subsystem names
+    Core::JSON::ArrayType<Core::JSON::EnumType<Subsystem>> required;
+    if (precondition.empty() == false && required.FromString(precondition) == false) {
+        LOG_WARN(callsign.c_str(), "Cannot parse preconditions %s", precondition.c_str());
+        return false;
     }
 
-    return success;
+    std::vector<Subsystem> requiredList;
+    auto entries = required.Elements();
+    while (entries.Next() == true) {
+        requiredList.push_back(entries.Current().Value());
+    }
+
+    Exchange::Controller::ISubsystems* subsystems = lifetime->QueryInterface<Exchange::Controller::ISubsystems>();
+    if (subsystems == nullptr) {
+        return false;
+    }
+
+    Exchange::Controller::ISubsystems::ISubsystemsIterator* iterator = nullptr;
+    const bool available = (subsystems->Subsystems(iterator) == Core::ERROR_NONE && iterator != nullptr);
+    if (available == true) {
+        unmet = unmetSubsystems(requiredList, activeSubsystems(iterator));
+        iterator->Release();
+    }
+    subsystems->Release();
+
+    return available;
+}
+
+/**
+ * @brief Only wake up early for subsystem changes once all of the given subsystems are as required
+ *
+ * While waiting on subsystems, state changes of other plugins are ignored too. An empty list goes back to
+ * waking up for any change
+ */
+void COMRPCStarter::awaitSubsystems(const std::vector<Subsystem>& subsystems)
+{
+    std::lock_guard<std::mutex> lock(_eventLock);
+    _awaitedSubsystems = subsystems;
+}
+
+/**
+ * @brief Called from the COM-RPC threads when the controller reports a change
+ *
+ * @param[in]   callsign        Plugin that changed state (empty for subsystem changes)
+ * @param[in]   relevantToAll   True if the change could unblock any plugin, not just the named one
+ */
+void COMRPCStarter::onControllerEvent(const string& callsign, const bool relevantToAll)
+{
+    std::lock_guard<std::mutex> lock(_eventLock);
+
+    if ((relevantToAll && _awaitedSubsystems.empty()) || callsign == _currentCallsign) {
+        _events++;
+        _eventSignal.notify_all();
+    }
+}
+
+void COMRPCStarter::onSubsystemChange(Exchange::Controller::ISubsystems::ISubsystemsIterator* subsystems)
+{
+    std::vector<Subsystem> awaited;
+    {
+        std::lock_guard<std::mutex> lock(_eventLock);
+        awaited = _awaitedSubsystems;
+    }
+
+    // Without anything specific to wait for, a subsystem change could satisfy the preconditions of any plugin
+    if (awaited.empty() == true || unmetSubsystems(awaited, activeSubsystems(subsystems)).empty() == true) {
+        std::lock_guard<std::mutex> lock(_eventLock);
+        _awaitedSubsystems.clear();
+        _events++;
+        _eventSignal.notify_all();
+    }
+}
+
+uint64_t COMRPCStarter::eventCount() const
+{
+    std::lock_guard<std::mutex> lock(_eventLock);
+    return _events;
+}
+
+/**
+ * @brief Wait before retrying
+ *
+ * Returns early if a relevant controller event has arrived since the given event count was taken,
+ * the delay only acts as a safety net in case we are not notified. Even when woken straight away, at
+ * least kMinEventRetryMs is waited so related events arriving together are handled by a single retry
+ *
+ * @return True if woken by an event, false if the full delay elapsed
+ */
+bool COMRPCStarter::waitForEvent(const uint64_t since, const uint32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(_eventLock);
+
+    if (_lifetimeEvents == nullptr && _subsystemEvents == nullptr) {
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const bool woken = _eventSignal.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this, since]() {
+        return _events != since;
+    });
+    lock.unlock();
+
+    if (woken) {
+        const auto settle = start + std::chrono::milliseconds(std::min(kMinEventRetryMs, timeoutMs));
+        std::this_thread::sleep_until(settle);
+    }
+
+    return woken;
 }
 
-bool COMRPCStarter::deactivatePlugin(const uint8_t maxRetries, const uint16_t retryDelayMs)
+/**
+ * @brief Wait before reconnecting to the controller
+ *
+ * While Thunder is not accepting connections on its socket this returns as soon as it starts to, rather
+ * than sleeping for the whole delay. If the socket is already accepting connections (the controller
+ * itself failed us) or isn't a unix socket, the full delay is waited
+ *
+ * @return True if woken by the socket becoming ready, false if the full delay elapsed
+ */
+bool COMRPCStarter::waitForController(const uint32_t timeoutMs)
 {
+    const string socketPath = communicatorPath();
+
+    if (socketPath.empty() || isCommunicatorReachable(socketPath)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        return false;
+    }
+
+    return waitForCommunicator(socketPath, timeoutMs);
+}
+
+/**
+ * @brief Path of the unix socket the controller connection will use
+ *
+ * @return Socket path, or an empty string if Thunder is not reached through a unix socket
+ */
+string COMRPCStarter::communicatorPath()
+{
+    const Core::NodeId connector = ControllerConnector::Connector();
+
+    if (connector.Type() != Core::NodeId::TYPE_DOMAIN) {
+        return string();
+    }
+
+    return connector.HostName();
+}
+
+/**
+ * @brief Run an operation on a plugin, retrying according to the policy until it succeeds or we give up
+ *
+ * The controller connection is left open on return so it can be reused for the next plugin
+ *
+ * @param[in]   callsign        Callsign of the plugin
+ * @param[in]   operation       What to do with the plugin
+ * @param[in]   policy          How to retry if the operation fails
+ *
+ * @return True if the operation succeeded, false if we gave up
+ */
+bool COMRPCStarter::execute(const string& callsign, const Operation operation, const RetryPolicy& policy)
+{
+    const char* verb = operationName(operation);
+
     bool success = false;
-    int currentRetry = 1;
+    bool retry = true;
+    bool hung = false;
+    bool unsupported = false;
+    RetryPolicy::Schedule schedule(policy);
 
-    while (!success && currentRetry <= maxRetries) {
-        LOG_INF(_pluginName.c_str(), "Attempting to deactivate plugin - attempt %d/%d", currentRetry, maxRetries);
+    {
+        std::lock_guard<std::mutex> lock(_eventLock);
+        _currentCallsign = callsign;
+    }
 
-        auto start = Core::Time::Now();
+    ActivationTrace::Scope total("plugin", callsign);
+    const auto begin = Core::Time::Now();
 
-        if (_connector.IsOperational() == false) {
-            uint32_t result = _connector.Open(RPC::CommunicationTimeOut, ControllerConnector::Connector());
-            if(result != Core::ERROR_NONE) {
-                LOG_ERROR(_pluginName.c_str(), "Failed to get controller interface, error %u (%s)", result, Core::ErrorToString(result));
-            }
+    while (!success && retry) {
+        if (policy.maxAttempts() != 0) {
+            LOG_INF(callsign.c_str(), "Attempting to %s plugin - attempt %u/%u", verb, schedule.counted(), policy.maxAttempts());
+        } else {
+            LOG_INF(callsign.c_str(), "Attempting to %s plugin - attempt %u", verb, schedule.attempt());
         }
 
-        Exchange::Controller::ILifeTime* lifetime = _connector.Interface();
+        auto start = Core::Time::Now();
+        uint32_t delayMs = 0;
+
+        awaitSubsystems({});
+        Exchange::Controller::ILifeTime* lifetime = controller(callsign, schedule.attempt());
 
         if (lifetime == nullptr) {
-            LOG_ERROR(_pluginName.c_str(), "Failed to open ILifeTime interface" );
-            currentRetry++;
+            LOG_ERROR(callsign.c_str(), "Failed to open ILifeTime interface");
 
-            _connector.Close(RPC::CommunicationTimeOut);
+            disconnect();
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(retryDelayMs));
+            // Wait for Thunder to (re)create its socket, then try again
+            retry = schedule.next(delayMs);
+            if (retry) {
+                ActivationTrace::Scope trace("retry-wait", callsign, schedule.attempt() - 1);
+                LOG_DBG(callsign.c_str(), "Will retry after at most %ums", delayMs);
+                if (waitForController(delayMs)) {
+                    LOG_DBG(callsign.c_str(), "Controller socket is accepting connections, retrying now");
+                }
+            }
         } else {
-            uint32_t result = lifetime->Deactivate(_pluginName.c_str());
+            // Will block until the plugin has changed state (or the call timeout, or the deadline)
+            const uint32_t timeoutMs = schedule.callTimeoutMs(_callTimeoutMs);
+            Core::hresult result;
+            {
+                ActivationTrace::Scope trace(verb, callsign, schedule.attempt());
+                result = invoke(lifetime, callsign, operation, timeoutMs, hung);
+                trace.result(result);
+            }
+
+            // Only what happens after the call is a reason to retry early - state changes made by the call
+            // itself (e.g. the plugin going to PRECONDITION) are its outcome, not news
+            const uint64_t events = eventCount();
+            StateBoard::instance().publishResult(callsign, operation, result);
 
             auto duration = Core::Time::Now().Sub(start.MilliSeconds());
 
-            if (result != Core::ERROR_NONE) {
-                LOG_ERROR(_pluginName.c_str(), "Failed to deactivate plugin with error %u (%s) after %dms", result, Core::ErrorToString(result), duration.MilliSeconds());
-                currentRetry++;
-                std::this_thread::sleep_for(std::chrono::milliseconds(retryDelayMs));
+            if (!hung && notSupported(operation, result)) {
+                LOG_ERROR(callsign.c_str(), "Cannot %s plugin - not supported by Thunder or the plugin, error %u (%s)", verb, result, Core::ErrorToString(result));
+                retry = false;
+                unsupported = true;
+            } else if (result != Core::ERROR_NONE) {
+                if (hung) {
+                    // Counts as a failed attempt. The next one goes over a fresh connection, and Thunder answers
+                    // it straight away (in progress) for as long as the plugin is still stuck
+                    LOG_ERROR(callsign.c_str(), "Plugin hung - %s call did not return within %ums, abandoning it", verb, timeoutMs);
+                } else if (result == Core::ERROR_PENDING_CONDITIONS) {
+                    std::vector<Subsystem> unmet;
+
+                    if (unmetPreconditions(lifetime, callsign, unmet) == true && unmet.empty() == false) {
+                        LOG_ERROR(callsign.c_str(), "Failed to %s plugin after %llums - waiting for subsystem(s): %s", verb, static_cast<unsigned long long>(duration.MilliSeconds()), subsystemNames(unmet).c_str());
+                        awaitSubsystems(unmet);
+                    } else {
+                        LOG_ERROR(callsign.c_str(), "Failed to %s plugin due to unmet preconditions after %llums", verb, static_cast<unsigned long long>(duration.MilliSeconds()));
+                    }
+                } else {
+                    LOG_ERROR(callsign.c_str(), "Failed to %s plugin with error %u (%s) after %llums", verb, result, Core::ErrorToString(result), static_cast<unsigned long long>(duration.MilliSeconds()));
+                }
+
+                // Try again until the policy tells us to give up
+                retry = schedule.next(delayMs);
+                if (retry) {
+                    ActivationTrace::Scope trace("retry-wait", callsign, schedule.attempt() - 1);
+                    LOG_DBG(callsign.c_str(), "Will retry after at most %ums", delayMs);
+                    if (waitForEvent(events, delayMs)) {
+                        // Not counted against the maximum, otherwise a busy boot would use up all attempts in moments
+                        LOG_DBG(callsign.c_str(), "Controller state changed, retrying now");
+                        schedule.refund();
+                    }
+                }
             } else {
-                LOG_INF(_pluginName.c_str(), "Successfully deactivated plugin after %dms", duration.MilliSeconds());
+                // Our work here is done!
+                LOG_INF(callsign.c_str(), "Successfully %sd plugin after %llums", verb, static_cast<unsigned long long>(duration.MilliSeconds()));
                 success = true;
+
+                if (operation == Operation::Activate) {
+                    const uint32_t totalMs = Core::Time::Now().Sub(begin.MilliSeconds()).MilliSeconds();
+                    ActivationHistory::instance().record(callsign, duration.MilliSeconds(), totalMs);
+                    ActivationMetrics::instance().recordActivation(callsign, static_cast<uint64_t>(totalMs) * 1000);
+                }
             }
             lifetime->Release();
         }
     }
 
-    if (!success) {
-        LOG_ERROR(_pluginName.c_str(), "Max retries hit - giving up deactivating the plugin");
-    }
+    total.result(success ? Core::ERROR_NONE : Core::ERROR_GENERAL);
 
-    if (_connector.IsOperational() == true) {
-        _connector.Close(RPC::CommunicationTimeOut);
+    if (!success && !unsupported) {
+        if (schedule.expired()) {
+            LOG_ERROR(callsign.c_str(), "Deadline of %ums hit - giving up trying to %s the plugin", policy.deadlineMs(), verb);
+        } else {
+            LOG_ERROR(callsign.c_str(), "Max retries hit - giving up trying to %s the plugin", verb);
+        }
     }
 
     return success;
@@ -20,27 +20,109 @@
 #pragma once
 #include "Module.h"
 
+#include "CallWatchdog.h"
 #include "IPluginStarter.h"
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 using namespace WPEFramework;
 
 /**
  * @brief COM-RPC implementation of a plugin starter
  *
- * Connects to Thunder over COM-RPC and attempts to start a given plugin
+ * Connects to Thunder over COM-RPC and attempts to start the requested plugins. The connection to
+ * the controller is opened on first use and kept open until the starter is destroyed, so any number
+ * of plugins can be driven through a single connection
+ *
+ * While connected the starter listens for plugin state and subsystem changes from the controller, so
+ * a failed attempt is retried as soon as something relevant changes rather than after a fixed delay.
+ * When a plugin is held back by its preconditions, the starter looks up which subsystems are missing
+ * and only retries early once all of them are in the required state
+ *
+ * Besides activating and deactivating, plugins can be hibernated and resumed. A Thunder without hibernate
+ * support (or a plugin that can't be hibernated) fails these straight away rather than being retried
+ *
+ * With a call timeout or a deadline, each lifecycle call is made under a watchdog, limited to the call
+ * timeout or the time left until the deadline, whichever is shorter. A call that doesn't return in time
+ * counts as a failed attempt and the connection it is stuck on is abandoned, so the starter can retry and
+ * carry on with other plugins over a fresh connection
  */
 class COMRPCStarter : public IPluginStarter {
 public:
-    explicit COMRPCStarter(const string& pluginName);
-    ~COMRPCStarter() override = default;
+    explicit COMRPCStarter(const uint32_t callTimeoutMs = 0);
+    ~COMRPCStarter() override;
+
+    bool execute(const string& callsign, const Operation operation, const RetryPolicy& policy) override;
 
-    bool activatePlugin(const uint8_t maxRetries, const uint16_t retryDelayMs) override;
-    bool deactivatePlugin(const uint8_t maxRetries, const uint16_t retryDelayMs) override;
+    static string communicatorPath();
 
 private:
     using ControllerConnector = RPC::SmartControllerInterfaceType<Exchange::Controller::ILifeTime>;
+    using Subsystem = PluginHost::ISubSystem::subsystem;
+
+    class Notification : public Exchange::Controller::ILifeTime::INotification,
+                         public Exchange::Controller::ISubsystems::INotification {
+    public:
+        explicit Notification(COMRPCStarter& parent)
+            : _lock()
+            , _parent(&parent)
+        {
+        }
+        ~Notification() override = default;
+
+        Notification(const Notification&) = delete;
+        Notification& operator=(const Notification&) = delete;
+
+        void StateChange(const string& callsign, const PluginHost::IShell::state& state, const PluginHost::IShell::reason& reason) override;
+        void SubsystemChange(Exchange::Controller::ISubsystems::ISubsystemsIterator* const subsystems) override;
+
+        void detach();
+
+        BEGIN_INTERFACE_MAP(Notification)
+        INTERFACE_ENTRY(Exchange::Controller::ILifeTime::INotification)
+        INTERFACE_ENTRY(Exchange::Controller::ISubsystems::INotification)
+        END_INTERFACE_MAP
+
+    private:
+        // Outlives the starter when its connection is abandoned
+        std::mutex _lock;
+        COMRPCStarter* _parent;
+    };
 
 private:
-    ControllerConnector _connector;
-    const string _pluginName;
+    Exchange::Controller::ILifeTime* controller(const string& callsign, const uint32_t attempt);
+    void disconnect();
+    Core::hresult invoke(Exchange::Controller::ILifeTime* lifetime, const string& callsign, const Operation operation, const uint32_t timeoutMs, bool& hung);
+    void abandonConnection();
+
+    void registerNotifications(Exchange::Controller::ILifeTime* lifetime);
+    void unregisterNotifications();
+
+    bool unmetPreconditions(Exchange::Controller::ILifeTime* lifetime, const string& callsign, std::vector<Subsystem>& unmet) const;
+    void awaitSubsystems(const std::vector<Subsystem>& subsystems);
+
+    void onControllerEvent(const string& callsign, const bool relevantToAll);
+    void onSubsystemChange(Exchange::Controller::ISubsystems::ISubsystemsIterator* subsystems);
+    uint64_t eventCount() const;
+    bool waitForEvent(const uint64_t since, const uint32_t timeoutMs);
+    bool waitForController(const uint32_t timeoutMs);
+
+private:
+    const uint32_t _callTimeoutMs;
+    CallWatchdog _watchdog;
+
+    std::shared_ptr<ControllerConnector> _connector;
+
+    Notification* _notification;
+    Exchange::Controller::ILifeTime* _lifetimeEvents;
+    Exchange::Controller::ISubsystems* _subsystemEvents;
+
+    mutable std::mutex _eventLock;
+    std::condition_variable _eventSignal;
+    uint64_t _events;
+    string _currentCallsign;
+    std::vector<Subsystem> _awaitedSubsystems;
 };
@@ -0,0 +1,178 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CallWatchdog.h"
+
+#include "Log.h"
+
+CallWatchdog::CallWatchdog()
+    : _executor()
+    , _thread()
+{
+}
+
+CallWatchdog::~CallWatchdog()
+{
+    if (_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_executor->lock);
+            _executor->stop = true;
+            _executor->signal.notify_all();
+        }
+        _thread.join();
+    }
+}
+
+/**
+ * @brief Make a call, waiting no longer than the timeout for it to return
+ *
+ * @param[in]   call        The call to make. Must not reference anything that may go away while it is
+ *                          blocked, as an abandoned call keeps running after this returns
+ * @param[in]   timeoutMs   How long to wait for the call
+ * @param[out]  result      What the call returned
+ *
+ * @return True if the call returned in time. If not, the caller must abandon() it
+ */
+bool CallWatchdog::run(const Call& call, const uint32_t timeoutMs, uint32_t& result)
+{
+    if (!_executor) {
+        _executor = std::make_shared<Executor>();
+        _thread = std::thread(&CallWatchdog::loop, _executor);
+    }
+
+    std::unique_lock<std::mutex> lock(_executor->lock);
+
+    _executor->call = call;
+    _executor->pending = true;
+    _executor->done = false;
+    _executor->signal.notify_all();
+
+    if (!_executor->signal.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return _executor->done; })) {
+        return false;
+    }
+
+    result = _executor->result;
+    return true;
+}
+
+/**
+ * @brief Give up on the call that just timed out
+ *
+ * @param[in]   cleanup     Run once the call returns, on the thread that made it. Runs straight away if
+ *                          the call returned in the meantime
+ */
+void CallWatchdog::abandon(const Cleanup& cleanup)
+{
+    if (!_executor) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_executor->lock);
+
+    if (_executor->done) {
+        // Returned after all, so the thread can be kept for the next call
+        lock.unlock();
+        if (cleanup) {
+            cleanup();
+        }
+        return;
+    }
+
+    // Counted before the executor can see it is abandoned, a call returning right after must not uncount it first
+    {
+        std::lock_guard<std::mutex> outstanding(abandoned().lock);
+        abandoned().count++;
+    }
+
+    _executor->abandoned = true;
+    _executor->cleanup = cleanup;
+    lock.unlock();
+
+    _thread.detach();
+    _executor.reset();
+}
+
+void CallWatchdog::loop(const std::shared_ptr<Executor> executor)
+{
+    std::unique_lock<std::mutex> lock(executor->lock);
+
+    while (true) {
+        executor->signal.wait(lock, [&executor]() { return executor->pending || executor->stop; });
+
+        if (!executor->pending) {
+            break;
+        }
+
+        Call call;
+        std::swap(call, executor->call);
+        executor->pending = false;
+        executor->start = std::chrono::steady_clock::now();
+
+        lock.unlock();
+        const uint32_t result = call();
+        lock.lock();
+
+        executor->result = result;
+        executor->done = true;
+        executor->signal.notify_all();
+
+        if (executor->abandoned) {
+            const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - executor->start).count();
+            LOG_WARN("Watchdog", "Abandoned call returned after %lldms with result %u", static_cast<long long>(elapsed), result);
+
+            Cleanup cleanup;
+            std::swap(cleanup, executor->cleanup);
+            lock.unlock();
+
+            if (cleanup) {
+                cleanup();
+            }
+
+            std::lock_guard<std::mutex> outstanding(abandoned().lock);
+            abandoned().count--;
+            abandoned().signal.notify_all();
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Wait for every abandoned call to return and be cleaned up
+ *
+ * @param[in]   timeoutMs   How long to wait at most
+ *
+ * @return False if some calls are still blocked, anything they use must then be left alone
+ */
+bool CallWatchdog::drain(const uint32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(abandoned().lock);
+
+    if (abandoned().count != 0) {
+        LOG_DBG("Watchdog", "Waiting for %u abandoned call(s) to return", abandoned().count);
+    }
+
+    return abandoned().signal.wait_for(lock, std::chrono::milliseconds(timeoutMs), []() { return abandoned().count == 0; });
+}
+
+CallWatchdog::Abandoned& CallWatchdog::abandoned()
+{
+    // Never destroyed, abandoned threads may still use it while the process exits
+    static Abandoned* outstanding = new Abandoned { {}, {}, 0 };
+    return *outstanding;
+}
@@ -0,0 +1,101 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+/**
+ * @brief Runs blocking calls with a time limit
+ *
+ * Calls such as ILifeTime::Activate() block until the plugin has changed state and can't be interrupted,
+ * so a plugin hanging in Initialize() would hang the caller with it. The watchdog makes the call on its
+ * own thread while the caller waits for at most the timeout.
+ *
+ * A call that overruns is abandoned: the caller is told straight away and hands over a cleanup to run if
+ * the call ever returns, for example to close the connection the call is stuck on. The thread stuck in the
+ * call is left to it and a fresh one is started for the next call. Before tearing down anything such a call
+ * may be using (e.g. at exit), drain() waits for the abandoned calls to return
+ */
+class CallWatchdog {
+public:
+    using Call = std::function<uint32_t()>;
+    using Cleanup = std::function<void()>;
+
+public:
+    CallWatchdog();
+    ~CallWatchdog();
+
+    CallWatchdog(const CallWatchdog&) = delete;
+    CallWatchdog& operator=(const CallWatchdog&) = delete;
+
+    bool run(const Call& call, const uint32_t timeoutMs, uint32_t& result);
+    void abandon(const Cleanup& cleanup);
+
+    static bool drain(const uint32_t timeoutMs);
+
+private:
+    struct Executor {
+        Executor()
+            : lock()
+            , signal()
+            , call()
+            , cleanup()
+            , pending(false)
+            , done(false)
+            , abandoned(false)
+            , stop(false)
+            , result(0)
+            , start()
+        {
+        }
+
+        std::mutex lock;
+        std::condition_variable signal;
+        Call call;
+        Cleanup cleanup;
+        bool pending;
+        bool done;
+        bool abandoned;
+        bool stop;
+        uint32_t result;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // Calls abandoned by any watchdog that have not returned yet
+    struct Abandoned {
+        std::mutex lock;
+        std::condition_variable signal;
+        uint32_t count;
+    };
+
+private:
+    static void loop(const std::shared_ptr<Executor> executor);
+    static Abandoned& abandoned();
+
+private:
+    std::shared_ptr<Executor> _executor;
+    std::thread _thread;
+};
@@ -19,26 +19,97 @@
 
 #pragma once
 
+#include "RetryPolicy.h"
+
+#include <initializer_list>
 #include <string>
 
 /**
- * Interface to start a specified plugin
+ * Interface to start Thunder plugins
+ *
+ * A single starter instance may be used to run lifecycle operations on any number of plugins, allowing
+ * implementations to keep their connection to Thunder open between calls
  *
  * Could be implemented with JSON-RPC or COM-RPC
  */
 class IPluginStarter {
 public:
+    /**
+     * @brief Lifecycle operations a starter can run on a plugin
+     *
+     * Hibernate only applies to out-of-process plugins, and needs a Thunder built with hibernate support. Resume
+     * wakes up a hibernated plugin (by activating it), or resumes a suspended one
+     */
+    enum class Operation {
+        Activate,
+        Deactivate,
+        Hibernate,
+        Resume
+    };
+
     virtual ~IPluginStarter() = default;
 
     /**
-     * @brief Activate a Thunder plugin
+     * @brief Run a lifecycle operation on a Thunder plugin
+     *
+     * Will block until either the operation has succeeded or until the retry policy gives up
      *
-     * Will block until either the Thunder plugin has activated or until the maximum amount of retires has occurred
+     * @param[in]   callsign            Callsign of the plugin
+     * @param[in]   operation           What to do with the plugin
+     * @param[in]   policy              How often, how quickly and for how long to retry a failed operation - if the operation
+     *                                  has not succeeded before the policy gives up this method will return false
+     */
+    virtual bool execute(const std::string& callsign, const Operation operation, const RetryPolicy& policy) = 0;
+
+    bool activatePlugin(const std::string& callsign, const RetryPolicy& policy)
+    {
+        return execute(callsign, Operation::Activate, policy);
+    }
+
+    bool deactivatePlugin(const std::string& callsign, const RetryPolicy& policy)
+    {
+        return execute(callsign, Operation::Deactivate, policy);
+    }
+
+    /**
+     * @brief Name of the operation, as used on the command line, in the daemon protocol and in traces
+     */
+    static const char* operationName(const Operation operation)
+    {
+        switch (operation) {
+        case Operation::Activate:
+            return "activate";
+        case Operation::Deactivate:
+            return "deactivate";
+        case Operation::Hibernate:
+            return "hibernate";
+        case Operation::Resume:
+            return "resume";
+        }
+        return "unknown";
+    }
+
+    /**
+     * @brief Parse an operation name, see operationName()
      *
-     * @param[in]   maxRetries          Maximum amount of attempts to activate the plugin - if plugin is not activated within the amount of retries
-     *                                  this method will return false
-     * @param[in]   retryDelayMs        Amount of time to wait after a failed activation before retrying again
+     * @return False if the name is not recognised
+     */
+    static bool parseOperation(const std::string& name, Operation& operation)
+    {
+        for (Operation candidate : { Operation::Activate, Operation::Deactivate, Operation::Hibernate, Operation::Resume }) {
+            if (name == operationName(candidate)) {
+                operation = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Whether the operation takes plugins down, and so has to follow dependencies in reverse
      */
-    virtual bool activatePlugin(const uint8_t maxRetries, const uint16_t retryDelayMs) = 0;
-    virtual bool deactivatePlugin(const uint8_t maxRetries, const uint16_t retryDelayMs) = 0;
+    static bool reversesDependencies(const Operation operation)
+    {
+        return operation == Operation::Deactivate || operation == Operation::Hibernate;
+    }
 };
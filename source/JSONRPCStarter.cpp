@@ -0,0 +1,236 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "JSONRPCStarter.h"
+
+#include "ActivationHistory.h"
+#include "ActivationMetrics.h"
+#include "ActivationTrace.h"
+#include "Log.h"
+#include "StateBoard.h"
+
+#include <algorithm>
+#include <chrono>
+#include <strings.h>
+#include <thread>
+
+// Default Thunder JSON-RPC address on RDK devices
+static constexpr const TCHAR* kDefaultThunderAccess = _T("127.0.0.1:9998");
+
+// Activation can legitimately take a long time, so wait for the response far longer than for a normal call
+static constexpr uint32_t kInvokeTimeoutMs = 60000;
+
+// How long Thunder is given to hibernate a plugin's process, unless the call timeout is shorter
+static constexpr uint32_t kHibernateTimeoutMs = 10000;
+
+namespace {
+
+/**
+ * @brief The part of the Controller's status@<callsign> response we need
+ */
+class PluginStatus : public Core::JSON::Container {
+public:
+    PluginStatus()
+        : Core::JSON::Container()
+        , Callsign()
+        , State()
+    {
+        Init();
+    }
+
+    PluginStatus(const PluginStatus& copy)
+        : Core::JSON::Container()
+        , Callsign(copy.Callsign)
+        , State(copy.State)
+    {
+        Init();
+    }
+
+    PluginStatus& operator=(const PluginStatus& rhs)
+    {
+        Callsign = rhs.Callsign;
+        State = rhs.State;
+        return *this;
+    }
+
+    ~PluginStatus() override = default;
+
+private:
+    void Init()
+    {
+        Add(_T("callsign"), &Callsign);
+        Add(_T("state"), &State);
+    }
+
+public:
+    Core::JSON::String Callsign;
+    Core::JSON::String State;
+};
+
+}
+
+JSONRPCStarter::JSONRPCStarter(const uint32_t callTimeoutMs)
+    : IPluginStarter()
+    , _callTimeoutMs(callTimeoutMs)
+    , _link()
+{
+}
+
+/**
+ * @brief Get the link to the Controller, creating it on first use
+ */
+JSONRPCStarter::ControllerLink& JSONRPCStarter::controller()
+{
+    if (!_link) {
+        string access;
+        if (Core::SystemInfo::GetEnvironment(_T("THUNDER_ACCESS"), access) == false) {
+            Core::SystemInfo::SetEnvironment(_T("THUNDER_ACCESS"), kDefaultThunderAccess);
+        }
+
+        ActivationTrace::Scope trace("open", string());
+        _link.reset(new ControllerLink(_T("Controller.1")));
+    }
+
+    return *_link;
+}
+
+/**
+ * @brief Whether the plugin is currently hibernated, false if its state can't be read
+ */
+bool JSONRPCStarter::hibernated(const string& callsign, const uint32_t timeoutMs)
+{
+    Core::JSON::ArrayType<PluginStatus> status;
+
+    if (controller().Get(timeoutMs, _T("status@") + callsign, status) != Core::ERROR_NONE) {
+        return false;
+    }
+
+    auto entries = status.Elements();
+    return entries.Next() == true && strcasecmp(entries.Current().State.Value().c_str(), "hibernated") == 0;
+}
+
+/**
+ * @brief Invoke a Controller method for the plugin, retrying according to the policy until it succeeds or we give up
+ */
+bool JSONRPCStarter::execute(const string& callsign, const Operation operation, const RetryPolicy& policy)
+{
+    // The Controller's JSON-RPC methods are named after the operations
+    const string method = operationName(operation);
+
+    bool success = false;
+    bool retry = true;
+    bool unsupported = false;
+    RetryPolicy::Schedule schedule(policy);
+
+    ActivationTrace::Scope total("plugin", callsign);
+    const auto begin = Core::Time::Now();
+
+    while (!success && retry) {
+        if (policy.maxAttempts() != 0) {
+            LOG_INF(callsign.c_str(), "Attempting to %s plugin over JSON-RPC - attempt %u/%u", method.c_str(), schedule.counted(), policy.maxAttempts());
+        } else {
+            LOG_INF(callsign.c_str(), "Attempting to %s plugin over JSON-RPC - attempt %u", method.c_str(), schedule.attempt());
+        }
+
+        auto start = Core::Time::Now();
+
+        // Never wait for the response past the deadline
+        const uint32_t timeoutMs = schedule.callTimeoutMs(_callTimeoutMs);
+        const uint32_t invokeTimeoutMs = (timeoutMs != 0) ? timeoutMs : kInvokeTimeoutMs;
+
+        // "resume" only resumes a suspended plugin (IStateControl), a hibernated one is woken up by activating it.
+        // Looking that up takes from the same time limit, so the attempt as a whole stays within it
+        string invoked = method;
+        uint32_t remainingMs = invokeTimeoutMs;
+
+        if (operation == Operation::Resume) {
+            const auto queried = std::chrono::steady_clock::now();
+
+            if (hibernated(callsign, invokeTimeoutMs)) {
+                invoked = operationName(Operation::Activate);
+            }
+
+            const auto spentMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - queried).count();
+            remainingMs = (spentMs < invokeTimeoutMs) ? static_cast<uint32_t>(invokeTimeoutMs - spentMs) : 0;
+        }
+
+        JsonObject parameters;
+        parameters[_T("callsign")] = callsign;
+        if (operation == Operation::Hibernate) {
+            parameters[_T("timeout")] = std::min(remainingMs, kHibernateTimeoutMs);
+        }
+
+        JsonObject response;
+        uint32_t result = Core::ERROR_TIMEDOUT;
+        {
+            ActivationTrace::Scope trace(method.c_str(), callsign, schedule.attempt());
+            if (remainingMs != 0) {
+                result = controller().Invoke<JsonObject, JsonObject>(remainingMs, invoked, parameters, response);
+            }
+            trace.result(result);
+        }
+        StateBoard::instance().publishResult(callsign, operation, result);
+
+        auto duration = Core::Time::Now().Sub(start.MilliSeconds());
+
+        if (result == Core::ERROR_NONE) {
+            LOG_INF(callsign.c_str(), "Successfully %sd plugin after %llums", method.c_str(), static_cast<unsigned long long>(duration.MilliSeconds()));
+            success = true;
+
+            if (operation == Operation::Activate) {
+                const uint32_t totalMs = Core::Time::Now().Sub(begin.MilliSeconds()).MilliSeconds();
+                ActivationHistory::instance().record(callsign, duration.MilliSeconds(), totalMs);
+                ActivationMetrics::instance().recordActivation(callsign, static_cast<uint64_t>(totalMs) * 1000);
+            }
+        } else if ((operation == Operation::Hibernate || operation == Operation::Resume) && result == Core::ERROR_NOT_SUPPORTED) {
+            LOG_ERROR(callsign.c_str(), "Cannot %s plugin - not supported by Thunder or the plugin, error %u (%s)", method.c_str(), result, Core::ErrorToString(result));
+            unsupported = true;
+            retry = false;
+        } else {
+            if (result == Core::ERROR_TIMEDOUT && timeoutMs != 0) {
+                // Counts as a failed attempt, like any other
+                LOG_ERROR(callsign.c_str(), "Plugin hung - %s call did not return within %ums", method.c_str(), timeoutMs);
+            } else if (result == Core::ERROR_PENDING_CONDITIONS) {
+                LOG_ERROR(callsign.c_str(), "Failed to %s plugin due to unmet preconditions after %llums", method.c_str(), static_cast<unsigned long long>(duration.MilliSeconds()));
+            } else {
+                LOG_ERROR(callsign.c_str(), "Failed to %s plugin with error %u (%s) after %llums", method.c_str(), result, Core::ErrorToString(result), static_cast<unsigned long long>(duration.MilliSeconds()));
+            }
+
+            uint32_t delayMs = 0;
+            retry = schedule.next(delayMs);
+            if (retry) {
+                ActivationTrace::Scope trace("retry-wait", callsign, schedule.attempt() - 1);
+                LOG_DBG(callsign.c_str(), "Will retry after %ums", delayMs);
+                std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+            }
+        }
+    }
+
+    total.result(success ? Core::ERROR_NONE : Core::ERROR_GENERAL);
+
+    if (!success && !unsupported) {
+        if (schedule.expired()) {
+            LOG_ERROR(callsign.c_str(), "Deadline of %ums hit - giving up trying to %s the plugin", policy.deadlineMs(), method.c_str());
+        } else {
+            LOG_ERROR(callsign.c_str(), "Max retries hit - giving up trying to %s the plugin", method.c_str());
+        }
+    }
+
+    return success;
+}
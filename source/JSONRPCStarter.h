@@ -0,0 +1,57 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "Module.h"
+
+#include "IPluginStarter.h"
+
+#include <memory>
+
+using namespace WPEFramework;
+
+/**
+ * @brief JSON-RPC implementation of a plugin starter
+ *
+ * Runs lifecycle operations on plugins through the Controller's JSON-RPC interface over a websocket. Used
+ * where the COM-RPC communicator socket can't be reached (e.g. from inside a container).
+ *
+ * The Thunder address is taken from the THUNDER_ACCESS environment variable (defaulting to
+ * 127.0.0.1:9998). Like the COM-RPC starter, the connection is opened on first use and kept open until
+ * the starter is destroyed. Retries always wait for the full delay as no notifications are subscribed to.
+ * The call timeout, if given, is used as the time to wait for each response
+ */
+class JSONRPCStarter : public IPluginStarter {
+public:
+    explicit JSONRPCStarter(const uint32_t callTimeoutMs = 0);
+    ~JSONRPCStarter() override = default;
+
+    bool execute(const string& callsign, const Operation operation, const RetryPolicy& policy) override;
+
+private:
+    using ControllerLink = JSONRPC::LinkType<Core::JSON::IElement>;
+
+private:
+    ControllerLink& controller();
+    bool hibernated(const string& callsign, const uint32_t timeoutMs);
+
+private:
+    const uint32_t _callTimeoutMs;
+    std::unique_ptr<ControllerLink> _link;
+};
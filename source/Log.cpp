@@ -19,11 +19,468 @@
 
 #include "Log.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <errno.h>
+#include <mutex>
+#include <stdarg.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
 int gActivatorLogLevel = LEVEL_INFO;
 
-void initLogging(int logLevel)
+namespace {
+
+// Must be a power of two
+constexpr size_t kRingSize = 512;
+constexpr size_t kMaxMessage = 384;
+constexpr size_t kMaxTag = 64;
+constexpr size_t kMaxPhase = 32;
+
+// The writer wakes up this often even if nobody signals it
+constexpr uint32_t kIdleWaitMs = 100;
+constexpr uint32_t kFlushTimeoutMs = 1000;
+
+constexpr const char* kJournalSocket = "/run/systemd/journal/socket";
+
+struct Record {
+    int level;
+    int line;
+    const char* file;
+    const char* function;
+    char plugin[kMaxTag];
+    char phase[kMaxPhase]; // Empty unless this is a phase timing
+    uint64_t durationUs;
+    uint32_t result;
+    char message[kMaxMessage];
+};
+
+int journalPriority(const int level)
+{
+    switch (level) {
+    case LEVEL_ERROR:
+        return 3;
+    case LEVEL_WARN:
+        return 4;
+    case LEVEL_INFO:
+        return 6;
+    default:
+        return 7;
+    }
+}
+
+void copyString(char* destination, const char* source, const size_t size)
+{
+    strncpy(destination, (source != nullptr) ? source : "", size - 1);
+    destination[size - 1] = '\0';
+}
+
+/**
+ * @brief Append a field in the journal's native protocol
+ *
+ * Values containing a newline have to be sent in the binary form: name, newline, little endian
+ * 64-bit length, value, newline
+ */
+void appendField(std::string& datagram, const char* name, const char* value)
+{
+    const size_t length = strlen(value);
+
+    datagram += name;
+    if (memchr(value, '\n', length) == nullptr) {
+        datagram += '=';
+    } else {
+        datagram += '\n';
+        for (int i = 0; i < 8; i++) {
+            datagram += static_cast<char>((static_cast<uint64_t>(length) >> (8 * i)) & 0xFF);
+        }
+    }
+    datagram.append(value, length);
+    datagram += '\n';
+}
+
+void appendField(std::string& datagram, const char* name, const uint64_t value)
+{
+    appendField(datagram, name, std::to_string(value).c_str());
+}
+
+void appendLine(std::string& buffer, const Record& record)
+{
+    char line[kMaxMessage + kMaxTag + 128];
+    snprintf(line, sizeof(line), "%s[%s:%d][%s] (%s) %s\n", getLogLevel(record.level), record.file, record.line,
+        record.function, record.plugin, record.message);
+    buffer += line;
+}
+
+void writeAll(const int fd, const std::string& buffer)
+{
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+        const ssize_t written = write(fd, buffer.data() + offset, buffer.size() - offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            break;
+        }
+        offset += written;
+    }
+}
+
+/**
+ * @brief Formats log records into a bounded lock-free ring and writes them out on a background thread
+ *
+ * The ring is a bounded multi-producer queue (each slot carries a sequence number that tells producers
+ * and the writer whose turn it is), so logging from any number of threads costs a vsnprintf and a
+ * couple of atomic operations. The writer is only woken through the mutex when it is idle.
+ */
+class AsyncLogger {
+public:
+    static AsyncLogger& instance()
+    {
+        static AsyncLogger logger;
+        return logger;
+    }
+
+    void start(const LogTarget target)
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        _target = target;
+        if (_target == LogTarget::Journal && !openJournal()) {
+            _target = LogTarget::Stderr;
+        }
+
+        if (!_running) {
+            _running = true;
+            _writer = std::thread(&AsyncLogger::run, this);
+            atexit([]() { AsyncLogger::instance().stop(); });
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            if (!_running) {
+                return;
+            }
+            _running = false;
+            _wake.notify_one();
+        }
+
+        _writer.join();
+    }
+
+    /**
+     * @brief Wait (for a bounded time) until everything logged so far has been written out
+     */
+    void flush()
+    {
+        const size_t target = _head.load();
+
+        std::unique_lock<std::mutex> lock(_lock);
+        if (_running) {
+            _wake.notify_one();
+            _flushed.wait_for(lock, std::chrono::milliseconds(kFlushTimeoutMs), [this, target]() { return _tail >= target; });
+        }
+    }
+
+    /**
+     * @brief Fill in a record, in place in the ring if the writer is running
+     */
+    template <typename FILL>
+    void log(FILL fill)
+    {
+        if (!_running) {
+            Record record;
+            fill(record);
+            write(&record, 1);
+            return;
+        }
+
+        size_t position = _head.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        while (true) {
+            slot = &_slots[position & (kRingSize - 1)];
+            const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+            if (sequence == position) {
+                if (_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (sequence < position) {
+                // Full, never block the caller on the writer
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                position = _head.load(std::memory_order_relaxed);
+            }
+        }
+
+        fill(slot->record);
+        slot->sequence.store(position + 1);
+
+        if (_sleeping.load() && _sleeping.exchange(false)) {
+            std::lock_guard<std::mutex> lock(_lock);
+            _wake.notify_one();
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+private:
+    AsyncLogger()
+        : _slots()
+        , _head(0)
+        , _tail(0)
+        , _dropped(0)
+        , _sleeping(false)
+        , _lock()
+        , _wake()
+        , _flushed()
+        , _running(false)
+        , _target(LogTarget::Stderr)
+        , _journal(-1)
+        , _writer()
+    {
+        for (size_t i = 0; i < kRingSize; i++) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~AsyncLogger()
+    {
+        if (_journal >= 0) {
+            close(_journal);
+        }
+    }
+
+    bool openJournal()
+    {
+        if (_journal >= 0) {
+            return true;
+        }
+
+        _journal = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (_journal < 0) {
+            return false;
+        }
+
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        copyString(address.sun_path, kJournalSocket, sizeof(address.sun_path));
+
+        if (connect(_journal, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+            fprintf(stderr, "Cannot connect to the journal (%s), logging to stderr\n", strerror(errno));
+            close(_journal);
+            _journal = -1;
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Take the next record off the ring, if one has been published
+     */
+    Record* next()
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        Slot& slot = _slots[tail & (kRingSize - 1)];
+        return (slot.sequence.load() == tail + 1) ? &slot.record : nullptr;
+    }
+
+    void release()
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        _slots[tail & (kRingSize - 1)].sequence.store(tail + kRingSize, std::memory_order_release);
+        _tail.store(tail + 1);
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+
+        while (true) {
+            lock.unlock();
+
+            std::string buffer;
+            bool wrote = false;
+            Record* record;
+
+            while ((record = next()) != nullptr) {
+                if (_target == LogTarget::Journal) {
+                    sendJournal(*record);
+                } else {
+                    appendLine(buffer, *record);
+                }
+                release();
+                wrote = true;
+            }
+
+            const uint32_t dropped = _dropped.exchange(0);
+            if (dropped > 0) {
+                Record warning;
+                warning.level = LEVEL_WARN;
+                warning.line = __LINE__;
+                warning.file = __FILENAME__;
+                warning.function = __FUNCTION__;
+                warning.phase[0] = '\0';
+                copyString(warning.plugin, "Log", sizeof(warning.plugin));
+                snprintf(warning.message, sizeof(warning.message), "Log buffer full, dropped %u messages", dropped);
+                write(&warning, 1);
+            }
+
+            if (!buffer.empty()) {
+                writeAll(STDERR_FILENO, buffer);
+            }
+
+            lock.lock();
+
+            if (wrote) {
+                _flushed.notify_all();
+                continue;
+            }
+            if (!_running) {
+                break;
+            }
+
+            // Go to sleep, but check for a record published before the producers could see we were sleeping
+            _sleeping = true;
+            if (next() != nullptr) {
+                _sleeping = false;
+                continue;
+            }
+            _wake.wait_for(lock, std::chrono::milliseconds(kIdleWaitMs));
+            _sleeping = false;
+        }
+    }
+
+    void write(const Record* records, const size_t count)
+    {
+        std::string buffer;
+
+        for (size_t i = 0; i < count; i++) {
+            if (_target == LogTarget::Journal) {
+                sendJournal(records[i]);
+            } else {
+                appendLine(buffer, records[i]);
+            }
+        }
+
+        if (!buffer.empty()) {
+            writeAll(STDERR_FILENO, buffer);
+        }
+    }
+
+    void sendJournal(const Record& record)
+    {
+        std::string datagram;
+        datagram.reserve(kMaxMessage + 256);
+
+        appendField(datagram, "MESSAGE", record.message);
+        appendField(datagram, "PRIORITY", journalPriority(record.level));
+        appendField(datagram, "SYSLOG_IDENTIFIER", program_invocation_short_name);
+        appendField(datagram, "CODE_FILE", record.file);
+        appendField(datagram, "CODE_LINE", record.line);
+        appendField(datagram, "CODE_FUNC", record.function);
+        appendField(datagram, "CALLSIGN", record.plugin);
+
+        if (record.phase[0] != '\0') {
+            appendField(datagram, "PHASE", record.phase);
+            appendField(datagram, "DURATION_US", record.durationUs);
+            appendField(datagram, "RESULT", record.result);
+        }
+
+        if (send(_journal, datagram.data(), datagram.size(), MSG_NOSIGNAL) < 0) {
+            std::string line;
+            appendLine(line, record);
+            writeAll(STDERR_FILENO, line);
+        }
+    }
+
+private:
+    Slot _slots[kRingSize];
+    std::atomic<size_t> _head;
+    std::atomic<size_t> _tail;
+    std::atomic<uint32_t> _dropped;
+    std::atomic<bool> _sleeping;
+
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _flushed;
+    std::atomic<bool> _running;
+
+    LogTarget _target;
+    int _journal;
+    std::thread _writer;
+};
+
+}
+
+void initLogging(int logLevel, LogTarget target)
 {
     gActivatorLogLevel = logLevel;
+    AsyncLogger::instance().start(target);
+}
+
+void flushLogging()
+{
+    AsyncLogger::instance().flush();
+}
+
+bool parseLogTarget(const char* name, LogTarget& target)
+{
+    if (strcmp(name, "stderr") == 0) {
+        target = LogTarget::Stderr;
+    } else if (strcmp(name, "journal") == 0) {
+        target = LogTarget::Journal;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void logMessage(int level, const char* file, int line, const char* function, const char* plugin, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+
+    AsyncLogger::instance().log([&](Record& record) {
+        record.level = level;
+        record.line = line;
+        record.file = file;
+        record.function = function;
+        record.phase[0] = '\0';
+        copyString(record.plugin, plugin, sizeof(record.plugin));
+        vsnprintf(record.message, sizeof(record.message), fmt, args);
+    });
+
+    va_end(args);
+}
+
+void logPhase(const char* file, int line, const char* function, const char* callsign, const char* phase, uint64_t durationUs, uint32_t result)
+{
+    AsyncLogger::instance().log([&](Record& record) {
+        record.level = LEVEL_DEBUG;
+        record.line = line;
+        record.file = file;
+        record.function = function;
+        record.durationUs = durationUs;
+        record.result = result;
+        copyString(record.plugin, callsign, sizeof(record.plugin));
+        copyString(record.phase, phase, sizeof(record.phase));
+        snprintf(record.message, sizeof(record.message), "%s took %lluus", phase, static_cast<unsigned long long>(durationUs));
+    });
 }
 
 const char* getLogLevel(int level)
@@ -40,4 +497,4 @@ const char* getLogLevel(int level)
     default:
         return "";
     }
-}
\ No newline at end of file
+}
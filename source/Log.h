@@ -19,14 +19,24 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 extern int gActivatorLogLevel;
 
+/**
+ * @brief File name part of a path, evaluated at compile time where possible
+ */
+constexpr const char* logFileName(const char* path, const char* name)
+{
+    return (*path == '\0') ? name : logFileName(path + 1, (*path == '/') ? path + 1 : name);
+}
+
+// The build defines __FILENAME__ for every source file, this is the fallback for other builds
 #ifndef __FILENAME__
-#define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
+#define __FILENAME__ logFileName(__FILE__, __FILE__)
 #endif
 
 #define LEVEL_DEBUG 3
@@ -46,11 +56,42 @@ extern int gActivatorLogLevel;
 #define LOG_ERROR(plugin, fmt, ...) \
     __LOG(LEVEL_ERROR, plugin, fmt, ##__VA_ARGS__)
 
-#define __LOG(level, plugin, fmt, ...)                                                                                                        \
-    do {                                                                                                                                      \
-        if (__builtin_expect(((level) <= gActivatorLogLevel), 0))                                                                             \
-            fprintf(stderr, "%s[%s:%d][%s] (%s) " fmt "\n", getLogLevel(level), __FILENAME__, __LINE__, __FUNCTION__, plugin, ##__VA_ARGS__); \
+// Phase timing with the callsign, phase and duration kept as separate fields for the journal
+#define LOG_PHASE(callsign, phase, durationUs, result)                                           \
+    do {                                                                                         \
+        if (__builtin_expect((LEVEL_DEBUG <= gActivatorLogLevel), 0))                            \
+            logPhase(__FILENAME__, __LINE__, __FUNCTION__, callsign, phase, durationUs, result); \
     } while (0)
 
-void initLogging(int logLevel);
-const char* getLogLevel(int level);
\ No newline at end of file
+#define __LOG(level, plugin, fmt, ...)                                                                \
+    do {                                                                                              \
+        if (__builtin_expect(((level) <= gActivatorLogLevel), 0))                                     \
+            logMessage(level, __FILENAME__, __LINE__, __FUNCTION__, plugin, fmt, ##__VA_ARGS__); \
+    } while (0)
+
+/**
+ * Where log messages are written
+ *  - Stderr:   Plain text lines on stderr
+ *  - Journal:  Structured records sent straight to the systemd journal socket, with the callsign (and
+ *              for phase timings the phase and duration) as separate fields
+ */
+enum class LogTarget {
+    Stderr,
+    Journal
+};
+
+/**
+ * Once logging is initialised messages are formatted into a lock-free ring buffer and written out by a
+ * background thread, so logging never blocks the caller on I/O. If the buffer is full messages are
+ * dropped (and the number dropped is reported) rather than waiting. Before initLogging() is called
+ * messages are written synchronously to stderr.
+ */
+void initLogging(int logLevel, LogTarget target = LogTarget::Stderr);
+void flushLogging();
+bool parseLogTarget(const char* name, LogTarget& target);
+
+void logMessage(int level, const char* file, int line, const char* function, const char* plugin, const char* fmt, ...)
+    __attribute__((format(printf, 6, 7)));
+void logPhase(const char* file, int line, const char* function, const char* callsign, const char* phase, uint64_t durationUs, uint32_t result);
+
+const char* getLogLevel(int level);
@@ -0,0 +1,290 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Manifest.h"
+
+#include "Module.h"
+
+#include "Log.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace WPEFramework;
+
+namespace {
+
+class RetryConfig : public Core::JSON::Container {
+public:
+    RetryConfig()
+        : Core::JSON::Container()
+        , Backoff()
+        , Attempts(0)
+        , Delay(0)
+        , MaxDelay(0)
+        , Deadline(0)
+        , CallTimeout(0)
+    {
+        Init();
+    }
+
+    RetryConfig(const RetryConfig& copy)
+        : Core::JSON::Container()
+        , Backoff(copy.Backoff)
+        , Attempts(copy.Attempts)
+        , Delay(copy.Delay)
+        , MaxDelay(copy.MaxDelay)
+        , Deadline(copy.Deadline)
+        , CallTimeout(copy.CallTimeout)
+    {
+        Init();
+    }
+
+    RetryConfig& operator=(const RetryConfig& rhs)
+    {
+        Backoff = rhs.Backoff;
+        Attempts = rhs.Attempts;
+        Delay = rhs.Delay;
+        MaxDelay = rhs.MaxDelay;
+        Deadline = rhs.Deadline;
+        CallTimeout = rhs.CallTimeout;
+        return *this;
+    }
+
+    ~RetryConfig() override = default;
+
+    /**
+     * @brief Apply the fields that are set on top of an existing policy
+     *
+     * @param[in]   base    Policy to start from
+     * @param[in]   keep    Manifest::RetrySetting flags for the fields of the base that must not be overridden
+     * @param[out]  policy  The result
+     */
+    bool Apply(const RetryPolicy& base, const uint32_t keep, RetryPolicy& policy) const
+    {
+        RetryPolicy::Backoff backoff = base.backoff();
+
+        if (Backoff.IsSet() && (keep & Manifest::RetryBackoff) == 0 && !RetryPolicy::parseBackoff(Backoff.Value().c_str(), backoff)) {
+            LOG_ERROR("Manifest", "Unknown backoff strategy '%s'", Backoff.Value().c_str());
+            return false;
+        }
+
+        const uint32_t attempts = Pick(Attempts, keep & Manifest::RetryAttempts, base.maxAttempts());
+        const uint32_t deadline = Pick(Deadline, keep & Manifest::RetryDeadline, base.deadlineMs());
+        const uint32_t callDeadline = Pick(Deadline, keep & Manifest::RetryDeadline, base.callDeadlineMs());
+
+        if (attempts == 0 && deadline == 0) {
+            LOG_ERROR("Manifest", "Unlimited attempts require a deadline");
+            return false;
+        }
+
+        policy = RetryPolicy(backoff, attempts,
+            Pick(Delay, keep & Manifest::RetryDelay, base.delayMs()),
+            Pick(MaxDelay, keep & Manifest::RetryMaxDelay, base.maxDelayMs()),
+            deadline, callDeadline);
+        policy.callTimeoutMs(Pick(CallTimeout, keep & Manifest::RetryCallTimeout, base.callTimeoutMs()));
+
+        return true;
+    }
+
+private:
+    void Init()
+    {
+        Add(_T("backoff"), &Backoff);
+        Add(_T("attempts"), &Attempts);
+        Add(_T("delay"), &Delay);
+        Add(_T("maxdelay"), &MaxDelay);
+        Add(_T("deadline"), &Deadline);
+        Add(_T("calltimeout"), &CallTimeout);
+    }
+
+    static uint32_t Pick(const Core::JSON::DecUInt32& field, const uint32_t keep, const uint32_t base)
+    {
+        return (field.IsSet() && keep == 0) ? field.Value() : base;
+    }
+
+public:
+    Core::JSON::String Backoff;
+    Core::JSON::DecUInt32 Attempts;
+    Core::JSON::DecUInt32 Delay;
+    Core::JSON::DecUInt32 MaxDelay;
+    Core::JSON::DecUInt32 Deadline;
+    Core::JSON::DecUInt32 CallTimeout;
+};
+
+class PluginConfig : public Core::JSON::Container {
+public:
+    PluginConfig()
+        : Core::JSON::Container()
+        , Callsign()
+        , Depends()
+        , Priority(0)
+        , Cost(0)
+        , Retry()
+    {
+        Init();
+    }
+
+    PluginConfig(const PluginConfig& copy)
+        : Core::JSON::Container()
+        , Callsign(copy.Callsign)
+        , Depends(copy.Depends)
+        , Priority(copy.Priority)
+        , Cost(copy.Cost)
+        , Retry(copy.Retry)
+    {
+        Init();
+    }
+
+    PluginConfig& operator=(const PluginConfig& rhs)
+    {
+        Callsign = rhs.Callsign;
+        Depends = rhs.Depends;
+        Priority = rhs.Priority;
+        Cost = rhs.Cost;
+        Retry = rhs.Retry;
+        return *this;
+    }
+
+    ~PluginConfig() override = default;
+
+private:
+    void Init()
+    {
+        Add(_T("callsign"), &Callsign);
+        Add(_T("depends"), &Depends);
+        Add(_T("priority"), &Priority);
+        Add(_T("cost"), &Cost);
+        Add(_T("retry"), &Retry);
+    }
+
+public:
+    Core::JSON::String Callsign;
+    Core::JSON::ArrayType<Core::JSON::String> Depends;
+    Core::JSON::DecSInt32 Priority;
+    Core::JSON::DecUInt32 Cost;
+    RetryConfig Retry;
+};
+
+class ManifestConfig : public Core::JSON::Container {
+public:
+    ManifestConfig()
+        : Core::JSON::Container()
+        , Jobs(0)
+        , Retry()
+        , Plugins()
+    {
+        Add(_T("jobs"), &Jobs);
+        Add(_T("retry"), &Retry);
+        Add(_T("plugins"), &Plugins);
+    }
+
+    ManifestConfig(const ManifestConfig&) = delete;
+    ManifestConfig& operator=(const ManifestConfig&) = delete;
+
+    ~ManifestConfig() override = default;
+
+public:
+    Core::JSON::DecUInt32 Jobs;
+    RetryConfig Retry;
+    Core::JSON::ArrayType<PluginConfig> Plugins;
+};
+
+}
+
+Manifest::Manifest()
+    : _jobs(0)
+    , _policy()
+    , _plugins()
+{
+}
+
+/**
+ * @brief Read and validate a manifest file
+ *
+ * @param[in]   path            Manifest to load
+ * @param[in]   defaultPolicy   Retry policy from the command line, used for anything the manifest doesn't set
+ * @param[in]   explicitSettings    RetrySetting flags for the settings given explicitly on the command line,
+ *                                  the top level "retry" leaves these alone
+ *
+ * @return False if the file could not be read or is not a valid manifest
+ */
+bool Manifest::load(const std::string& path, const RetryPolicy& defaultPolicy, const uint32_t explicitSettings)
+{
+    std::ifstream file(path);
+    if (!file) {
+        LOG_ERROR("Manifest", "Cannot open manifest %s", path.c_str());
+        return false;
+    }
+
+    std::stringstream content;
+    content << file.rdbuf();
+
+    ManifestConfig config;
+    Core::OptionalType<Core::JSON::Error> error;
+
+    if (!config.FromString(content.str(), error) || error.IsSet()) {
+        LOG_ERROR("Manifest", "Failed to parse %s: %s", path.c_str(), error.IsSet() ? error.Value().Message().c_str() : "unknown error");
+        return false;
+    }
+
+    // Parsed wider than it is stored, so an out of range value is reported rather than wrapped
+    if (config.Jobs.Value() > UINT8_MAX) {
+        LOG_ERROR("Manifest", "jobs must be between 1 and %d, not %u", UINT8_MAX, config.Jobs.Value());
+        return false;
+    }
+    _jobs = static_cast<uint8_t>(config.Jobs.Value());
+
+    if (!config.Retry.Apply(defaultPolicy, explicitSettings, _policy)) {
+        return false;
+    }
+
+    _plugins.clear();
+
+    auto plugins = config.Plugins.Elements();
+    while (plugins.Next()) {
+        const PluginConfig& entry = plugins.Current();
+
+        if (entry.Callsign.Value().empty()) {
+            LOG_ERROR("Manifest", "Plugin entry %zu in %s has no callsign", _plugins.size() + 1, path.c_str());
+            return false;
+        }
+
+        Plugin plugin;
+        plugin.callsign = entry.Callsign.Value();
+        plugin.priority = entry.Priority.Value();
+        plugin.costMs = entry.Cost.Value();
+        plugin.hasPolicy = entry.Retry.IsSet();
+
+        if (plugin.hasPolicy && !entry.Retry.Apply(_policy, 0, plugin.policy)) {
+            LOG_ERROR(plugin.callsign.c_str(), "Invalid retry settings in manifest");
+            return false;
+        }
+
+        auto depends = entry.Depends.Elements();
+        while (depends.Next()) {
+            plugin.depends.push_back(depends.Current().Value());
+        }
+
+        _plugins.push_back(plugin);
+    }
+
+    LOG_DBG("Manifest", "Loaded %zu plugin(s) from %s", _plugins.size(), path.c_str());
+    return true;
+}
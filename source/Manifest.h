@@ -0,0 +1,84 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "RetryPolicy.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Boot manifest describing every plugin to activate in one file
+ *
+ * A JSON document of the form:
+ *
+ *      {
+ *          "jobs": 4,
+ *          "retry": { "backoff": "jitter", "attempts": 20, "delay": 100, "maxdelay": 2000, "deadline": 30000, "calltimeout": 5000 },
+ *          "plugins": [
+ *              { "callsign": "Network", "priority": 10, "cost": 300 },
+ *              { "callsign": "OCDM", "depends": [ "Network" ], "retry": { "attempts": 5 } }
+ *          ]
+ *      }
+ *
+ * Every field except the callsigns is optional. "retry" at the top level replaces the retry options not given
+ * explicitly on the command line, "retry" on a plugin overrides individual fields for that plugin only.
+ * "calltimeout" limits a single call, like --call-timeout. "cost" is the expected activation time in ms, used to
+ * find the critical path, and "priority" takes precedence over it
+ */
+class Manifest {
+public:
+    enum RetrySetting : uint32_t {
+        RetryBackoff = 0x01,
+        RetryAttempts = 0x02,
+        RetryDelay = 0x04,
+        RetryMaxDelay = 0x08,
+        RetryDeadline = 0x10,
+        RetryCallTimeout = 0x20
+    };
+
+    struct Plugin {
+        std::string callsign;
+        std::vector<std::string> depends;
+        int32_t priority;
+        uint32_t costMs;
+        bool hasPolicy;
+        RetryPolicy policy;
+    };
+
+public:
+    Manifest();
+    ~Manifest() = default;
+
+    Manifest(const Manifest&) = delete;
+    Manifest& operator=(const Manifest&) = delete;
+
+    bool load(const std::string& path, const RetryPolicy& defaultPolicy, const uint32_t explicitSettings);
+
+    uint8_t jobs() const { return _jobs; }
+    const RetryPolicy& policy() const { return _policy; }
+    const std::vector<Plugin>& plugins() const { return _plugins; }
+
+private:
+    uint8_t _jobs;
+    RetryPolicy _policy;
+    std::vector<Plugin> _plugins;
+};
@@ -0,0 +1,108 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PluginSnapshot.h"
+
+#include "Log.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/**
+ * @brief Ask the controller which plugins are currently activated
+ *
+ * The controller itself is always running and is left out
+ */
+bool PluginSnapshot::capture(std::vector<string>& callsigns)
+{
+    RPC::SmartControllerInterfaceType<Exchange::Controller::ILifeTime> connector;
+
+    uint32_t result = connector.Open(RPC::CommunicationTimeOut, RPC::SmartControllerInterfaceType<Exchange::Controller::ILifeTime>::Connector());
+    if (result != Core::ERROR_NONE) {
+        LOG_ERROR("Snapshot", "Failed to connect to the controller, error %u (%s)", result, Core::ErrorToString(result));
+        return false;
+    }
+
+    Exchange::Controller::ILifeTime* lifetime = connector.Interface();
+    Exchange::Controller::IMetadata* metadata = nullptr;
+
+    if (lifetime != nullptr) {
+        metadata = lifetime->QueryInterface<Exchange::Controller::IMetadata>();
+        lifetime->Release();
+    }
+
+    if (metadata == nullptr) {
+        LOG_ERROR("Snapshot", "Controller metadata is not available");
+        connector.Close(RPC::CommunicationTimeOut);
+        return false;
+    }
+
+    // An empty callsign lists every plugin
+    Exchange::Controller::IMetadata::Data::IServicesIterator* services = nullptr;
+    result = metadata->Services(string(), services);
+
+    if (result == Core::ERROR_NONE && services != nullptr) {
+        Exchange::Controller::IMetadata::Data::Service service;
+
+        while (services->Next(service) == true) {
+            if (service.State == PluginHost::IShell::ACTIVATED && service.Callsign != _T("Controller")) {
+                callsigns.push_back(service.Callsign);
+            }
+        }
+        services->Release();
+    } else {
+        LOG_ERROR("Snapshot", "Failed to list plugins, error %u (%s)", result, Core::ErrorToString(result));
+    }
+
+    metadata->Release();
+    connector.Close(RPC::CommunicationTimeOut);
+
+    return (result == Core::ERROR_NONE);
+}
+
+/**
+ * @brief Write the snapshot, replacing any previous one atomically
+ */
+bool PluginSnapshot::save(const string& path, const std::vector<string>& callsigns)
+{
+    const string temporary = path + ".tmp." + std::to_string(getpid());
+
+    FILE* file = fopen(temporary.c_str(), "we");
+    if (file == nullptr) {
+        LOG_ERROR("Snapshot", "Cannot write %s (%s)", temporary.c_str(), strerror(errno));
+        return false;
+    }
+
+    fprintf(file, "# Plugins activated at the time of the snapshot, restore with PluginActivator --restore\n");
+    for (const string& callsign : callsigns) {
+        fprintf(file, "%s\n", callsign.c_str());
+    }
+
+    bool success = (fflush(file) == 0 && fsync(fileno(file)) == 0);
+    success = (fclose(file) == 0) && success;
+
+    if (!success || rename(temporary.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Snapshot", "Cannot write %s (%s)", path.c_str(), strerror(errno));
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,37 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "Module.h"
+
+#include <vector>
+
+using namespace WPEFramework;
+
+/**
+ * @brief Records which plugins are activated, so the same set can be brought back after Thunder restarts
+ *
+ * The snapshot is a plain callsign list in the same format as --file, one callsign per line, so it can
+ * be read back with --restore (or --file) and edited by hand
+ */
+class PluginSnapshot {
+public:
+    static bool capture(std::vector<string>& callsigns);
+    static bool save(const string& path, const std::vector<string>& callsigns);
+};
@@ -0,0 +1,391 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PluginSupervisor.h"
+
+#include "ActivationTrace.h"
+#include "Log.h"
+#include "StateBoard.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// A plugin that stays up this long is considered healthy again, and its restart delay starts over
+static constexpr uint32_t kStableMs = 60000;
+
+// More restarts than this within the window is a crash loop
+static constexpr uint32_t kMaxRestarts = 5;
+static constexpr uint32_t kCrashLoopWindowMs = 300000;
+
+// A restart is a single activation attempt bounded by this, the supervisor's own backoff does the retrying.
+// Restarts run on the event loop, so this is also how long events and stop() can be held up by one
+static constexpr uint32_t kRestartDeadlineMs = 10000;
+
+/**
+ * @brief A single attempt, bounded by the restart deadline
+ */
+static RetryPolicy restartPolicy(const RetryPolicy& policy)
+{
+    const uint32_t deadlineMs = (policy.callDeadlineMs() == 0) ? kRestartDeadlineMs : std::min(policy.callDeadlineMs(), kRestartDeadlineMs);
+
+    RetryPolicy restart(policy.backoff(), 1, policy.delayMs(), policy.maxDelayMs(), deadlineMs);
+    restart.callTimeoutMs(policy.callTimeoutMs());
+    return restart;
+}
+
+PluginSupervisor::PluginSupervisor(const std::vector<string>& callsigns, std::unique_ptr<IPluginStarter> starter, const RetryPolicy& policy)
+    : _policy(policy)
+    , _restartPolicy(restartPolicy(policy))
+    , _starter(std::move(starter))
+    , _plugins()
+    , _crashLooped(false)
+    , _connector(*this)
+    , _notification(*this)
+    , _lifetime(nullptr)
+    , _lock()
+    , _events()
+    , _connected(false)
+    , _stopFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+    , _wakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+    const Clock::time_point now = Clock::now();
+
+    for (const string& callsign : callsigns) {
+        _plugins[callsign] = { true, false, now, now, policy.delayMs(), {} };
+    }
+}
+
+PluginSupervisor::~PluginSupervisor()
+{
+    if (_lifetime != nullptr) {
+        _lifetime->Unregister(&_notification);
+        _lifetime->Release();
+    }
+
+    if (_connector.IsOperational() == true) {
+        _connector.Close(RPC::CommunicationTimeOut);
+    }
+
+    close(_stopFd);
+    close(_wakeFd);
+}
+
+void PluginSupervisor::Connector::Operational(const bool upAndRunning)
+{
+    _parent.onOperational(upAndRunning);
+}
+
+void PluginSupervisor::Notification::StateChange(const string& callsign, const PluginHost::IShell::state& state, const PluginHost::IShell::reason& reason)
+{
+    StateBoard::instance().publishState(callsign, state);
+    _parent.onStateChange(callsign, state, reason);
+}
+
+/**
+ * @brief Supervise the plugins until stop() is called, Thunder goes away or there is nothing left to supervise
+ *
+ * @return False if the connection to Thunder was lost or a plugin was given up on
+ */
+bool PluginSupervisor::run()
+{
+    if (!connect()) {
+        return false;
+    }
+
+    LOG_INF("Supervisor", "Supervising %zu plugin(s)", _plugins.size());
+
+    struct pollfd fds[2] = {
+        { _stopFd, POLLIN, 0 },
+        { _wakeFd, POLLIN, 0 }
+    };
+
+    while (supervising()) {
+        if (poll(fds, 2, pollTimeoutMs()) < 0 && errno != EINTR) {
+            LOG_ERROR("Supervisor", "poll failed (%s)", strerror(errno));
+            return false;
+        }
+
+        if (fds[0].revents != 0) {
+            LOG_INF("Supervisor", "Stopping");
+            return !_crashLooped;
+        }
+
+        if (fds[1].revents != 0) {
+            uint64_t value;
+            ssize_t drained = read(_wakeFd, &value, sizeof(value));
+            (void)drained;
+        }
+
+        std::deque<Event> events;
+        bool connected;
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            events.swap(_events);
+            connected = _connected;
+        }
+
+        if (!connected) {
+            LOG_ERROR("Supervisor", "Lost the connection to Thunder");
+            return false;
+        }
+
+        for (const Event& event : events) {
+            handle(event);
+        }
+
+        restartDue();
+    }
+
+    LOG_INF("Supervisor", "Nothing left to supervise");
+    return !_crashLooped;
+}
+
+/**
+ * @brief Ask the supervisor to stop, safe to call from a signal handler
+ */
+void PluginSupervisor::stop()
+{
+    const uint64_t value = 1;
+    ssize_t written = write(_stopFd, &value, sizeof(value));
+    (void)written;
+}
+
+bool PluginSupervisor::connect()
+{
+    const uint32_t result = _connector.Open(RPC::CommunicationTimeOut, ControllerConnector::Connector());
+    if (result != Core::ERROR_NONE) {
+        LOG_ERROR("Supervisor", "Failed to connect to the controller, error %u (%s)", result, Core::ErrorToString(result));
+        return false;
+    }
+
+    _lifetime = _connector.Interface();
+    if (_lifetime == nullptr) {
+        LOG_ERROR("Supervisor", "Failed to get the ILifeTime interface");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _connected = true;
+    }
+
+    if (_lifetime->Register(&_notification) != Core::ERROR_NONE) {
+        LOG_ERROR("Supervisor", "Failed to register for plugin state changes");
+        _lifetime->Release();
+        _lifetime = nullptr;
+        return false;
+    }
+
+    // A plugin may already have gone down between being activated and registering
+    checkStates(_lifetime);
+    return true;
+}
+
+void PluginSupervisor::checkStates(Exchange::Controller::ILifeTime* lifetime)
+{
+    Exchange::Controller::IMetadata* metadata = lifetime->QueryInterface<Exchange::Controller::IMetadata>();
+    if (metadata == nullptr) {
+        return;
+    }
+
+    for (auto& entry : _plugins) {
+        Exchange::Controller::IMetadata::Data::IServicesIterator* services = nullptr;
+        Exchange::Controller::IMetadata::Data::Service service;
+
+        if (metadata->Services(entry.first, services) == Core::ERROR_NONE && services != nullptr) {
+            if (services->Next(service) == true && service.State == PluginHost::IShell::DEACTIVATED) {
+                LOG_WARN(entry.first.c_str(), "Plugin is already deactivated");
+                scheduleRestart(entry.first, entry.second);
+            }
+            services->Release();
+        }
+    }
+
+    metadata->Release();
+}
+
+void PluginSupervisor::handle(const Event& event)
+{
+    auto entry = _plugins.find(event.callsign);
+    if (entry == _plugins.end() || !entry->second.supervised) {
+        return;
+    }
+
+    Plugin& plugin = entry->second;
+
+    if (event.state == PluginHost::IShell::ACTIVATED) {
+        plugin.upSince = Clock::now();
+        plugin.restartPending = false;
+        return;
+    }
+
+    if (event.state != PluginHost::IShell::DEACTIVATED) {
+        return;
+    }
+
+    if (expected(event.reason)) {
+        if (event.reason == PluginHost::IShell::REQUESTED) {
+            LOG_INF(event.callsign.c_str(), "Plugin was deactivated on request, no longer supervising it");
+            plugin.supervised = false;
+        } else {
+            LOG_INF(event.callsign.c_str(), "Plugin was deactivated (%s), leaving it to Thunder", reasonName(event.reason));
+        }
+        return;
+    }
+
+    LOG_WARN(event.callsign.c_str(), "Plugin went down unexpectedly (%s)", reasonName(event.reason));
+    scheduleRestart(event.callsign, plugin);
+}
+
+void PluginSupervisor::scheduleRestart(const string& callsign, Plugin& plugin)
+{
+    if (plugin.restartPending) {
+        return;
+    }
+
+    const Clock::time_point now = Clock::now();
+
+    while (!plugin.restarts.empty() && now - plugin.restarts.front() > std::chrono::milliseconds(kCrashLoopWindowMs)) {
+        plugin.restarts.pop_front();
+    }
+
+    if (plugin.restarts.size() >= kMaxRestarts) {
+        LOG_ERROR(callsign.c_str(), "Plugin is crash looping - restarted %zu times in the last %us, giving up on it", plugin.restarts.size(), kCrashLoopWindowMs / 1000);
+        plugin.supervised = false;
+        _crashLooped = true;
+        return;
+    }
+
+    // Back off while the plugin keeps going down soon after being restarted
+    if (now - plugin.upSince >= std::chrono::milliseconds(kStableMs)) {
+        plugin.delayMs = _policy.delayMs();
+    } else if (!plugin.restarts.empty()) {
+        plugin.delayMs = std::min(std::max<uint32_t>(plugin.delayMs * 2, 1), _policy.maxDelayMs());
+    }
+
+    LOG_INF(callsign.c_str(), "Restarting plugin in %ums", plugin.delayMs);
+
+    plugin.restartPending = true;
+    plugin.restartAt = now + std::chrono::milliseconds(plugin.delayMs);
+}
+
+/**
+ * @brief Restart the first plugin that is due
+ *
+ * One per pass, so events and stop() are seen between restarts; the poll returns straight away while more
+ * restarts are due
+ */
+void PluginSupervisor::restartDue()
+{
+    for (auto& entry : _plugins) {
+        Plugin& plugin = entry.second;
+
+        if (!plugin.supervised || !plugin.restartPending || Clock::now() < plugin.restartAt) {
+            continue;
+        }
+
+        plugin.restarts.push_back(Clock::now());
+        plugin.restartPending = false;
+
+        if (_starter->activatePlugin(entry.first, _restartPolicy)) {
+            plugin.upSince = Clock::now();
+        } else {
+            // Counts towards the crash loop like any other failed restart
+            scheduleRestart(entry.first, plugin);
+        }
+
+        // Supervision can go on for the life of the box, don't buffer its trace events until exit
+        ActivationTrace::instance().flush();
+        return;
+    }
+}
+
+/**
+ * @brief Time until the next restart is due, or -1 to wait for events only
+ */
+int PluginSupervisor::pollTimeoutMs() const
+{
+    int timeoutMs = -1;
+    const Clock::time_point now = Clock::now();
+
+    for (const auto& entry : _plugins) {
+        const Plugin& plugin = entry.second;
+
+        if (plugin.supervised && plugin.restartPending) {
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(plugin.restartAt - now).count();
+            const int due = static_cast<int>(std::max<long long>(remaining, 0));
+            timeoutMs = (timeoutMs < 0) ? due : std::min(timeoutMs, due);
+        }
+    }
+
+    return timeoutMs;
+}
+
+bool PluginSupervisor::supervising() const
+{
+    return std::any_of(_plugins.begin(), _plugins.end(), [](const std::pair<const string, Plugin>& entry) {
+        return entry.second.supervised;
+    });
+}
+
+void PluginSupervisor::onStateChange(const string& callsign, const PluginHost::IShell::state state, const PluginHost::IShell::reason reason)
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _events.push_back({ callsign, state, reason });
+    }
+    wake();
+}
+
+void PluginSupervisor::onOperational(const bool operational)
+{
+    if (operational) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _connected = false;
+    }
+    wake();
+}
+
+void PluginSupervisor::wake()
+{
+    const uint64_t value = 1;
+    ssize_t written = write(_wakeFd, &value, sizeof(value));
+    (void)written;
+}
+
+/**
+ * @brief Whether a deactivation for this reason is intended (or handled by Thunder) rather than a crash
+ */
+bool PluginSupervisor::expected(const PluginHost::IShell::reason reason)
+{
+    return reason == PluginHost::IShell::REQUESTED || reason == PluginHost::IShell::SHUTDOWN || reason == PluginHost::IShell::CONDITIONS;
+}
+
+const char* PluginSupervisor::reasonName(const PluginHost::IShell::reason reason)
+{
+    const TCHAR* name = Core::EnumerateType<PluginHost::IShell::reason>(reason).Data();
+    return (name != nullptr) ? name : "unknown";
+}
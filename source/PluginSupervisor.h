@@ -0,0 +1,147 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "Module.h"
+
+#include "IPluginStarter.h"
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace WPEFramework;
+
+/**
+ * @brief Stays connected to Thunder after activation and re-activates plugins that go down unexpectedly
+ *
+ * Listens for plugin state changes on its own controller connection. A supervised plugin that is
+ * deactivated for any reason other than a request, Thunder shutting down or its preconditions going away
+ * (which Thunder recovers from by itself) is re-activated through the starter.
+ *
+ * Restarts back off: each restart of a plugin that hadn't stayed up for long waits twice as long as the
+ * previous one, between the policy's delay and maximum delay. Each restart is a single, time limited
+ * activation attempt. A plugin that needs too many restarts in a short time is crash looping and is given up
+ * on rather than restarted for ever
+ */
+class PluginSupervisor {
+public:
+    PluginSupervisor(const std::vector<string>& callsigns, std::unique_ptr<IPluginStarter> starter, const RetryPolicy& policy);
+    ~PluginSupervisor();
+
+    PluginSupervisor(const PluginSupervisor&) = delete;
+    PluginSupervisor& operator=(const PluginSupervisor&) = delete;
+
+    bool run();
+    void stop();
+
+private:
+    using ControllerConnector = RPC::SmartControllerInterfaceType<Exchange::Controller::ILifeTime>;
+    using Clock = std::chrono::steady_clock;
+
+    class Connector : public ControllerConnector {
+    public:
+        explicit Connector(PluginSupervisor& parent)
+            : _parent(parent)
+        {
+        }
+        ~Connector() override = default;
+
+        Connector(const Connector&) = delete;
+        Connector& operator=(const Connector&) = delete;
+
+        void Operational(const bool upAndRunning) override;
+
+    private:
+        PluginSupervisor& _parent;
+    };
+
+    class Notification : public Exchange::Controller::ILifeTime::INotification {
+    public:
+        explicit Notification(PluginSupervisor& parent)
+            : _parent(parent)
+        {
+        }
+        ~Notification() override = default;
+
+        Notification(const Notification&) = delete;
+        Notification& operator=(const Notification&) = delete;
+
+        void StateChange(const string& callsign, const PluginHost::IShell::state& state, const PluginHost::IShell::reason& reason) override;
+
+        BEGIN_INTERFACE_MAP(Notification)
+        INTERFACE_ENTRY(Exchange::Controller::ILifeTime::INotification)
+        END_INTERFACE_MAP
+
+    private:
+        PluginSupervisor& _parent;
+    };
+
+    struct Event {
+        string callsign;
+        PluginHost::IShell::state state;
+        PluginHost::IShell::reason reason;
+    };
+
+    struct Plugin {
+        bool supervised;
+        bool restartPending;
+        Clock::time_point restartAt;
+        Clock::time_point upSince;
+        uint32_t delayMs;
+        std::deque<Clock::time_point> restarts;
+    };
+
+private:
+    bool connect();
+    void checkStates(Exchange::Controller::ILifeTime* lifetime);
+    void handle(const Event& event);
+    void scheduleRestart(const string& callsign, Plugin& plugin);
+    void restartDue();
+    int pollTimeoutMs() const;
+    bool supervising() const;
+
+    void onStateChange(const string& callsign, const PluginHost::IShell::state state, const PluginHost::IShell::reason reason);
+    void onOperational(const bool operational);
+    void wake();
+
+    static bool expected(const PluginHost::IShell::reason reason);
+    static const char* reasonName(const PluginHost::IShell::reason reason);
+
+private:
+    const RetryPolicy _policy;
+    const RetryPolicy _restartPolicy;
+    std::unique_ptr<IPluginStarter> _starter;
+    std::map<string, Plugin> _plugins;
+    bool _crashLooped;
+
+    Connector _connector;
+    Core::Sink<Notification> _notification;
+    Exchange::Controller::ILifeTime* _lifetime;
+
+    std::mutex _lock;
+    std::deque<Event> _events;
+    bool _connected;
+
+    int _stopFd;
+    int _wakeFd;
+};
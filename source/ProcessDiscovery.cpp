@@ -0,0 +1,337 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProcessDiscovery.h"
+
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// comm is truncated to TASK_COMM_LEN (16) including the terminator
+static constexpr size_t kCommLength = 15;
+
+// Process creation can't be observed directly, so even with inotify we rescan /proc occasionally
+// in case the communicator socket lives somewhere unexpected
+static constexpr int kRescanIntervalMs = 1000;
+
+// Time between the socket being bound and Thunder calling listen() on it. A socket that keeps refusing
+// connections is most likely stale (left behind by a Thunder that is gone), so the retries back off up to
+// the maximum until the socket is created again
+static constexpr int kListenRetryMs = 10;
+static constexpr int kMaxListenRetryMs = 1000;
+
+/**
+ * @brief Read a small file from /proc into a buffer
+ *
+ * @return Number of bytes read, or -1 on failure
+ */
+static ssize_t readProcFile(const char* path, char* buffer, const size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    ssize_t length = read(fd, buffer, size - 1);
+    close(fd);
+
+    if (length >= 0) {
+        buffer[length] = '\0';
+    }
+    return length;
+}
+
+static bool matchesProcess(const char* pid, const std::vector<std::string>& processNames)
+{
+    char path[64];
+    char comm[32];
+
+    snprintf(path, sizeof(path), "/proc/%s/comm", pid);
+    ssize_t length = readProcFile(path, comm, sizeof(comm));
+    if (length <= 0) {
+        return false;
+    }
+
+    if (comm[length - 1] == '\n') {
+        comm[length - 1] = '\0';
+    }
+
+    for (const std::string& name : processNames) {
+        if (name.compare(0, kCommLength, comm) != 0) {
+            continue;
+        }
+
+        if (name.size() <= kCommLength) {
+            return true;
+        }
+
+        // Name was truncated in comm, so check the full name in argv[0]
+        char cmdline[256];
+        snprintf(path, sizeof(path), "/proc/%s/cmdline", pid);
+        if (readProcFile(path, cmdline, sizeof(cmdline)) > 0) {
+            const char* executable = strrchr(cmdline, '/');
+            executable = (executable != nullptr) ? executable + 1 : cmdline;
+
+            if (name == executable) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+uint32_t findProcess(const std::vector<std::string>& processNames)
+{
+    DIR* proc = opendir("/proc");
+    if (proc == nullptr) {
+        LOG_ERROR("Discovery", "Failed to open /proc (%s)", strerror(errno));
+        return 0;
+    }
+
+    const uint32_t self = static_cast<uint32_t>(getpid());
+    uint32_t pid = 0;
+
+    struct dirent* entry;
+    while (pid == 0 && (entry = readdir(proc)) != nullptr) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+            continue;
+        }
+
+        const uint32_t candidate = static_cast<uint32_t>(strtoul(entry->d_name, nullptr, 10));
+        if (candidate != self && matchesProcess(entry->d_name, processNames)) {
+            pid = candidate;
+        }
+    }
+
+    closedir(proc);
+    return pid;
+}
+
+bool isCommunicatorReachable(const std::string& socketPath)
+{
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+
+    socklen_t length = offsetof(struct sockaddr_un, sun_path) + socketPath.size();
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+    // Thunder uses a leading '@' for sockets in the abstract namespace
+    if (address.sun_path[0] == '@') {
+        address.sun_path[0] = '\0';
+    } else {
+        length++;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool reachable = (connect(fd, reinterpret_cast<struct sockaddr*>(&address), length) == 0);
+    close(fd);
+
+    return reachable;
+}
+
+static int openPidFd(const uint32_t pid)
+{
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, static_cast<pid_t>(pid), 0));
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Watch the directory containing the communicator socket so we wake up as soon as it is created
+ *
+ * @return inotify fd, or -1 if the socket can't be watched (abstract socket, missing directory...)
+ */
+static int watchSocketDirectory(const std::string& socketPath)
+{
+    if (socketPath.empty() || socketPath[0] == '@') {
+        return -1;
+    }
+
+    const size_t separator = socketPath.rfind('/');
+    const std::string directory = (separator == std::string::npos) ? "." : (separator == 0 ? "/" : socketPath.substr(0, separator));
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (inotify_add_watch(fd, directory.c_str(), IN_CREATE | IN_MOVED_TO | IN_ATTRIB) < 0) {
+        LOG_DBG("Discovery", "Cannot watch %s (%s), falling back to periodic checks", directory.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+uint32_t waitForProcess(const std::vector<std::string>& processNames, const std::string& socketPath, const uint32_t timeoutMs)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    int inotifyFd = watchSocketDirectory(socketPath);
+    int pidFd = -1;
+    uint32_t pid = 0;
+    bool ready = false;
+    int listenRetryMs = kListenRetryMs;
+
+    while (true) {
+        if (pid != 0 && pidFd < 0 && kill(static_cast<pid_t>(pid), 0) != 0) {
+            pid = 0;
+        }
+
+        if (pid == 0) {
+            pid = findProcess(processNames);
+            if (pid != 0) {
+                LOG_DBG("Discovery", "Found process with PID %u", pid);
+                pidFd = openPidFd(pid);
+            }
+        }
+
+        const bool socketExists = !socketPath.empty() && (socketPath[0] == '@' || access(socketPath.c_str(), F_OK) == 0);
+
+        if (pid != 0 && (socketPath.empty() || (socketExists && isCommunicatorReachable(socketPath)))) {
+            ready = true;
+            break;
+        }
+
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            break;
+        }
+
+        int interval = kRescanIntervalMs;
+        if (pid != 0 && socketExists) {
+            interval = listenRetryMs;
+            listenRetryMs = std::min(listenRetryMs * 2, kMaxListenRetryMs);
+        } else if (inotifyFd < 0 && pidFd < 0) {
+            interval = kRescanIntervalMs / 10;
+        }
+
+        struct pollfd fds[2];
+        nfds_t count = 0;
+
+        if (inotifyFd >= 0) {
+            fds[count++] = { inotifyFd, POLLIN, 0 };
+        }
+        if (pidFd >= 0) {
+            fds[count++] = { pidFd, POLLIN, 0 };
+        }
+
+        if (poll(fds, count, static_cast<int>(std::min<long long>(remaining, interval))) > 0) {
+            for (nfds_t i = 0; i < count; i++) {
+                if ((fds[i].revents & POLLIN) == 0) {
+                    continue;
+                }
+
+                if (fds[i].fd == pidFd) {
+                    // The process we found went away, start looking again
+                    LOG_WARN("Discovery", "Process %u exited while waiting for it to become ready", pid);
+                    close(pidFd);
+                    pidFd = -1;
+                    pid = 0;
+                } else {
+                    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+                    while (read(inotifyFd, events, sizeof(events)) > 0) {
+                    }
+                    // The socket may have been created again, by a Thunder that is about to listen on it
+                    listenRetryMs = kListenRetryMs;
+                }
+            }
+        }
+    }
+
+    if (pidFd >= 0) {
+        close(pidFd);
+    }
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+    }
+
+    return ready ? pid : 0;
+}
+
+bool waitForCommunicator(const std::string& socketPath, const uint32_t timeoutMs)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    int inotifyFd = watchSocketDirectory(socketPath);
+    bool ready = false;
+    int listenRetryMs = kListenRetryMs;
+
+    while (true) {
+        // Checked after the watch is in place, so the socket can't appear unnoticed in between
+        const bool socketExists = (socketPath[0] == '@' || access(socketPath.c_str(), F_OK) == 0);
+
+        if (socketExists && isCommunicatorReachable(socketPath)) {
+            ready = true;
+            break;
+        }
+
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            break;
+        }
+
+        int interval = kRescanIntervalMs;
+        if (socketExists) {
+            interval = listenRetryMs;
+            listenRetryMs = std::min(listenRetryMs * 2, kMaxListenRetryMs);
+        } else if (inotifyFd < 0) {
+            interval = kRescanIntervalMs / 10;
+        }
+
+        struct pollfd fds = { inotifyFd, POLLIN, 0 };
+
+        if (poll(&fds, (inotifyFd >= 0) ? 1 : 0, static_cast<int>(std::min<long long>(remaining, interval))) > 0) {
+            char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            while (read(inotifyFd, events, sizeof(events)) > 0) {
+            }
+            listenRetryMs = kListenRetryMs;
+        }
+    }
+
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+    }
+
+    return ready;
+}
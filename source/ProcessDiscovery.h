@@ -0,0 +1,72 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Native discovery of the Thunder process
+ *
+ * Scans /proc directly instead of spawning pidof, and can block until Thunder is up using inotify on the
+ * communicator socket directory and a pidfd on the Thunder process rather than sleeping in a loop
+ */
+
+/**
+ * @brief Find the first running process matching any of the given names
+ *
+ * Matches against /proc/<pid>/comm, falling back to the basename of argv[0] for names too long to
+ * fit in comm
+ *
+ * @return PID of the process, or 0 if none of the processes are running
+ */
+uint32_t findProcess(const std::vector<std::string>& processNames);
+
+/**
+ * @brief Check whether something is accepting connections on the given unix domain socket
+ */
+bool isCommunicatorReachable(const std::string& socketPath);
+
+/**
+ * @brief Wait until one of the given processes is running and its communicator socket is accepting connections
+ *
+ * If no socket path is given (e.g. Thunder is configured to use TCP), only waits for the process to appear
+ *
+ * @param[in]   processNames    Names of the process to look for
+ * @param[in]   socketPath      Path of the communicator unix socket, may be empty
+ * @param[in]   timeoutMs       Maximum amount of time to wait
+ *
+ * @return PID of the process, or 0 if it did not come up within the timeout
+ */
+uint32_t waitForProcess(const std::vector<std::string>& processNames, const std::string& socketPath, const uint32_t timeoutMs);
+
+/**
+ * @brief Wait until the communicator socket is accepting connections
+ *
+ * Sleeps on inotify events for the socket's directory, so returns as soon as Thunder binds and listens
+ * on the socket. Falls back to periodic checks where the socket can't be watched (e.g. abstract sockets)
+ *
+ * @param[in]   socketPath      Path of the communicator unix socket
+ * @param[in]   timeoutMs       Maximum amount of time to wait
+ *
+ * @return True if the socket is accepting connections, false if it did not within the timeout
+ */
+bool waitForCommunicator(const std::string& socketPath, const uint32_t timeoutMs);
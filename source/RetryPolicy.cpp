@@ -0,0 +1,226 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RetryPolicy.h"
+
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+
+RetryPolicy::RetryPolicy()
+    : RetryPolicy(Backoff::Fixed, 100, 500, 500, 0)
+{
+}
+
+/**
+ * @param[in]   backoff         How the delay between attempts changes
+ * @param[in]   maxAttempts     Maximum number of attempts, 0 for no limit (only sensible with a deadline).
+ *                              Up to as many refunded attempts (see refund()) are made on top
+ * @param[in]   delayMs         Base delay between attempts
+ * @param[in]   maxDelayMs      Upper bound for the delay between attempts
+ * @param[in]   deadlineMs      Give up after this long regardless of the number of attempts, 0 for no deadline.
+ *                              A call still in progress at the deadline is cut short
+ */
+RetryPolicy::RetryPolicy(const Backoff backoff, const uint32_t maxAttempts, const uint32_t delayMs, const uint32_t maxDelayMs, const uint32_t deadlineMs)
+    : RetryPolicy(backoff, maxAttempts, delayMs, maxDelayMs, deadlineMs, deadlineMs)
+{
+}
+
+/**
+ * @param[in]   deadlineMs      Stop retrying after this long, 0 for no deadline
+ * @param[in]   callDeadlineMs  Cut a call still in progress short after this long (counted from the start of the
+ *                              operation, like the deadline), 0 for no limit
+ */
+RetryPolicy::RetryPolicy(const Backoff backoff, const uint32_t maxAttempts, const uint32_t delayMs, const uint32_t maxDelayMs, const uint32_t deadlineMs, const uint32_t callDeadlineMs)
+    : _backoff(backoff)
+    , _maxAttempts(maxAttempts)
+    , _delayMs(delayMs)
+    , _maxDelayMs(std::max(maxDelayMs, delayMs))
+    , _deadlineMs(deadlineMs)
+    , _callDeadlineMs(callDeadlineMs)
+    , _callTimeoutMs(0)
+{
+}
+
+bool RetryPolicy::parseBackoff(const char* name, Backoff& backoff)
+{
+    if (strcmp(name, "fixed") == 0) {
+        backoff = Backoff::Fixed;
+    } else if (strcmp(name, "exponential") == 0) {
+        backoff = Backoff::Exponential;
+    } else if (strcmp(name, "jitter") == 0) {
+        backoff = Backoff::Jitter;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* RetryPolicy::backoffName(const Backoff backoff)
+{
+    switch (backoff) {
+    case Backoff::Fixed:
+        return "fixed";
+    case Backoff::Exponential:
+        return "exponential";
+    case Backoff::Jitter:
+        return "jitter";
+    default:
+        return "";
+    }
+}
+
+RetryPolicy::Schedule::Schedule(const RetryPolicy& policy)
+    : _policy(policy)
+    , _start(std::chrono::steady_clock::now())
+    , _attempt(1)
+    , _counted(1)
+    , _refunds(0)
+    , _previousDelayMs(policy.delayMs())
+    , _random(std::random_device()() ^ static_cast<uint32_t>(getpid()))
+{
+}
+
+/**
+ * @brief Called after a failed attempt to decide whether (and when) to try again
+ *
+ * @param[out]  delayMs     How long to wait before the next attempt
+ *
+ * @return True if another attempt should be made, false to give up
+ */
+bool RetryPolicy::Schedule::next(uint32_t& delayMs)
+{
+    if (_policy.maxAttempts() != 0 && _counted >= _policy.maxAttempts()) {
+        return false;
+    }
+
+    if (expired()) {
+        return false;
+    }
+
+    delayMs = backoff();
+
+    // Never sleep past the deadline, have one last attempt right at it instead
+    if (_policy.deadlineMs() != 0) {
+        delayMs = std::min(delayMs, remainingMs());
+    }
+
+    _attempt++;
+    _counted++;
+    return true;
+}
+
+/**
+ * @brief Don't count the upcoming attempt against the maximum number of attempts
+ *
+ * Used when a retry is brought forward because something changed, rather than because the delay ran out.
+ * The deadline still applies. At most the maximum number of attempts is refunded, so an operation whose
+ * own failures keep raising events still gives up eventually
+ */
+void RetryPolicy::Schedule::refund()
+{
+    if (_policy.maxAttempts() != 0 && _refunds >= _policy.maxAttempts()) {
+        return;
+    }
+
+    if (_counted > 1) {
+        _counted--;
+        _refunds++;
+    }
+}
+
+/**
+ * @return Time left until the deadline, or UINT32_MAX if there is no deadline
+ */
+uint32_t RetryPolicy::Schedule::remainingMs() const
+{
+    return remainingMs(_policy.deadlineMs());
+}
+
+uint32_t RetryPolicy::Schedule::remainingMs(const uint32_t deadlineMs) const
+{
+    if (deadlineMs == 0) {
+        return UINT32_MAX;
+    }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _start).count();
+    return (elapsed >= deadlineMs) ? 0 : static_cast<uint32_t>(deadlineMs - elapsed);
+}
+
+bool RetryPolicy::Schedule::expired() const
+{
+    return remainingMs() == 0;
+}
+
+/**
+ * @brief Limit single calls to this long, instead of the starter's call timeout
+ *
+ * @param[in]   callTimeoutMs   Limit for a single call, 0 to use the starter's
+ */
+void RetryPolicy::callTimeoutMs(const uint32_t callTimeoutMs)
+{
+    _callTimeoutMs = callTimeoutMs;
+}
+
+/**
+ * @brief Time limit for the next call: the call timeout, cut short at the call deadline
+ *
+ * A call still blocked at the deadline would otherwise keep the operation going past it
+ *
+ * @param[in]   defaultTimeoutMs    The starter's limit for a single call, 0 for none. The policy's own wins
+ *
+ * @return The limit, or 0 if there is neither a call timeout nor a deadline
+ */
+uint32_t RetryPolicy::Schedule::callTimeoutMs(const uint32_t defaultTimeoutMs) const
+{
+    const uint32_t callTimeoutMs = (_policy.callTimeoutMs() != 0) ? _policy.callTimeoutMs() : defaultTimeoutMs;
+
+    if (_policy.callDeadlineMs() == 0) {
+        return callTimeoutMs;
+    }
+
+    const uint32_t remaining = std::max<uint32_t>(remainingMs(_policy.callDeadlineMs()), 1);
+    return (callTimeoutMs == 0) ? remaining : std::min(callTimeoutMs, remaining);
+}
+
+uint32_t RetryPolicy::Schedule::backoff()
+{
+    uint64_t delay = _policy.delayMs();
+
+    switch (_policy.backoff()) {
+    case Backoff::Exponential: {
+        // _attempt is the attempt that just failed, so the first retry uses the base delay
+        const uint32_t shift = std::min<uint32_t>(_attempt - 1, 31);
+        delay = std::min<uint64_t>(static_cast<uint64_t>(_policy.delayMs()) << shift, _policy.maxDelayMs());
+        break;
+    }
+    case Backoff::Jitter: {
+        const uint64_t upper = std::max<uint64_t>(static_cast<uint64_t>(_previousDelayMs) * 3, _policy.delayMs());
+        std::uniform_int_distribution<uint64_t> distribution(_policy.delayMs(), upper);
+        delay = std::min<uint64_t>(distribution(_random), _policy.maxDelayMs());
+        break;
+    }
+    case Backoff::Fixed:
+    default:
+        break;
+    }
+
+    _previousDelayMs = static_cast<uint32_t>(delay);
+    return _previousDelayMs;
+}
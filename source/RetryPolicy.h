@@ -0,0 +1,114 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <stdint.h>
+
+/**
+ * @brief Describes how a failed plugin operation should be retried
+ *
+ * A policy is a plain description that can be shared between threads. Each operation creates its own
+ * Schedule from the policy to track attempts, the backoff state and the deadline
+ *
+ * The deadline normally both stops the retrying and cuts a call still in progress short. The two can be set
+ * apart: a deadline fitted from the activation history only stops retrying, while the run deadline also
+ * bounds calls
+ *
+ * Supported backoff strategies:
+ *  - Fixed:        Always wait the base delay
+ *  - Exponential:  Double the delay after every attempt, capped at the maximum delay
+ *  - Jitter:       "Decorrelated jitter" - a random delay between the base delay and three times the previous
+ *                  delay, capped at the maximum delay. Spreads out retries from many activators started together
+ */
+class RetryPolicy {
+public:
+    enum class Backoff {
+        Fixed,
+        Exponential,
+        Jitter
+    };
+
+    /**
+     * @brief Per-operation retry state created from a policy
+     */
+    class Schedule {
+    public:
+        explicit Schedule(const RetryPolicy& policy);
+        ~Schedule() = default;
+
+        Schedule(const Schedule&) = delete;
+        Schedule& operator=(const Schedule&) = delete;
+
+        bool next(uint32_t& delayMs);
+        void refund();
+
+        uint32_t attempt() const { return _attempt; }
+        uint32_t counted() const { return _counted; }
+        uint32_t remainingMs() const;
+        bool expired() const;
+        uint32_t callTimeoutMs(const uint32_t defaultTimeoutMs) const;
+
+    private:
+        uint32_t backoff();
+        uint32_t remainingMs(const uint32_t deadlineMs) const;
+
+    private:
+        const RetryPolicy& _policy;
+        const std::chrono::steady_clock::time_point _start;
+        uint32_t _attempt;
+        uint32_t _counted;
+        uint32_t _refunds;
+        uint32_t _previousDelayMs;
+        std::minstd_rand _random;
+    };
+
+public:
+    RetryPolicy();
+    RetryPolicy(const Backoff backoff, const uint32_t maxAttempts, const uint32_t delayMs, const uint32_t maxDelayMs, const uint32_t deadlineMs);
+    RetryPolicy(const Backoff backoff, const uint32_t maxAttempts, const uint32_t delayMs, const uint32_t maxDelayMs, const uint32_t deadlineMs, const uint32_t callDeadlineMs);
+    ~RetryPolicy() = default;
+
+    RetryPolicy(const RetryPolicy&) = default;
+    RetryPolicy& operator=(const RetryPolicy&) = default;
+
+    Backoff backoff() const { return _backoff; }
+    uint32_t maxAttempts() const { return _maxAttempts; }
+    uint32_t delayMs() const { return _delayMs; }
+    uint32_t maxDelayMs() const { return _maxDelayMs; }
+    uint32_t deadlineMs() const { return _deadlineMs; }
+    uint32_t callDeadlineMs() const { return _callDeadlineMs; }
+    uint32_t callTimeoutMs() const { return _callTimeoutMs; }
+    void callTimeoutMs(const uint32_t callTimeoutMs);
+
+    static bool parseBackoff(const char* name, Backoff& backoff);
+    static const char* backoffName(const Backoff backoff);
+
+private:
+    Backoff _backoff;
+    uint32_t _maxAttempts;
+    uint32_t _delayMs;
+    uint32_t _maxDelayMs;
+    uint32_t _deadlineMs;
+    uint32_t _callDeadlineMs;
+    uint32_t _callTimeoutMs;
+};
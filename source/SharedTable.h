@@ -0,0 +1,171 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/**
+ * Helpers for the fixed size hash tables kept in files shared between activator processes (see
+ * ActivationMetrics and StateBoard). Slots are never freed, so a key keeps its slot for the life of the file
+ */
+
+/**
+ * The state word of a slot. The low two bits hold the SlotState, while a slot is Claiming or Recovering the
+ * rest holds the PID of the process filling it in, so a waiter can tell a dead owner from a slow one
+ */
+enum SlotState : uint32_t {
+    Free = 0,
+    Claiming = 1,
+    Used = 2,
+    Recovering = 3 // Taken over from a process that died while claiming it
+};
+
+static constexpr uint32_t kSlotStateMask = 3;
+static constexpr uint32_t kSlotOwnerShift = 2;
+
+// How long to wait on another process holding a slot (claiming it, or writing to it) between checks on whether it died
+static constexpr uint32_t kSharedSlotSpins = 10000;
+
+inline uint32_t slotState(const uint32_t word)
+{
+    return word & kSlotStateMask;
+}
+
+inline uint32_t slotWord(const SlotState state, const pid_t owner)
+{
+    return (static_cast<uint32_t>(owner) << kSlotOwnerShift) | state;
+}
+
+/**
+ * @brief Whether the process holding a shared slot is gone, as opposed to just not scheduled for a while
+ */
+inline bool ownerDied(const pid_t owner)
+{
+    return owner > 0 && kill(owner, 0) == -1 && errno == ESRCH;
+}
+
+/**
+ * @brief Claim (or find) the slot for a key in a table shared with other processes
+ *
+ * Open addressing starting at the key's hash. A free slot is claimed with a compare-and-swap, filled in and
+ * then published; anyone finding a slot mid-claim waits for it to be published before comparing keys.
+ *
+ * A process that dies mid-claim would leave the slot claimed for ever, so every kSharedSlotSpins a waiter
+ * checks whether the claiming process still exists. Once it is gone one waiter takes the slot over and fills
+ * it in with its own key, the others wait for that and compare keys as usual. A live owner is waited for
+ * however long it takes, taking its slot would leave two processes filling in the same slot
+ *
+ * @return Index of the slot, or -1 if the table is full
+ */
+template <typename SLOT, typename MATCHES, typename FILL>
+inline int32_t claimSlot(SLOT* slots, const size_t count, const size_t hash, const MATCHES& matches, const FILL& fill)
+{
+    const pid_t self = getpid();
+
+    for (size_t probe = 0; probe < count; probe++) {
+        const size_t index = (hash + probe) % count;
+        SLOT& slot = slots[index];
+
+        uint32_t word = slot.state.load(std::memory_order_acquire);
+
+        if (word == Free) {
+            uint32_t expected = Free;
+            if (slot.state.compare_exchange_strong(expected, slotWord(Claiming, self), std::memory_order_acq_rel)) {
+                fill(slot);
+                slot.state.store(Used, std::memory_order_release);
+                return static_cast<int32_t>(index);
+            }
+            word = expected;
+        }
+
+        uint32_t spins = 0;
+        while (slotState(word) == Claiming || slotState(word) == Recovering) {
+            if (++spins >= kSharedSlotSpins) {
+                spins = 0;
+
+                if (ownerDied(static_cast<pid_t>(word >> kSlotOwnerShift))) {
+                    uint32_t expected = word;
+                    if (slot.state.compare_exchange_strong(expected, slotWord(Recovering, self), std::memory_order_acq_rel)) {
+                        fill(slot);
+                        slot.state.store(Used, std::memory_order_release);
+                        return static_cast<int32_t>(index);
+                    }
+                    // Someone else took it over and is filling it in, wait for them like for any claimer
+                    word = expected;
+                    continue;
+                }
+            }
+
+            sched_yield();
+            word = slot.state.load(std::memory_order_acquire);
+        }
+
+        if (word == Used && matches(slot)) {
+            return static_cast<int32_t>(index);
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief FNV-1a, so every activator build probes the shared tables the same way
+ */
+inline size_t hashName(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c != '\0'; c++) {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Find the slot for a key without claiming one, for readers that may only have the table mapped read-only
+ *
+ * A slot still being claimed is skipped, its key only counts once published
+ *
+ * @return Index of the slot, or -1 if the key is not in the table
+ */
+template <typename SLOT, typename MATCHES>
+inline int32_t findSlot(const SLOT* slots, const size_t count, const size_t hash, const MATCHES& matches)
+{
+    for (size_t probe = 0; probe < count; probe++) {
+        const size_t index = (hash + probe) % count;
+        const SLOT& slot = slots[index];
+
+        const uint32_t state = slot.state.load(std::memory_order_acquire);
+
+        if (state == Free) {
+            break;
+        }
+        if (state == Used && matches(slot)) {
+            return static_cast<int32_t>(index);
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,350 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Module.h"
+
+#include "StateBoard.h"
+#include "ActivationTrace.h"
+#include "Log.h"
+#include "SharedTable.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace WPEFramework;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "The state board needs lock-free atomics");
+
+static constexpr uint32_t kMagic = 0x42535050; // "PPSB"
+static constexpr uint32_t kVersion = 2;
+
+static constexpr size_t kMaxPlugins = 256;
+static constexpr size_t kCallsignLength = 64;
+
+// Published before the plugin's state is known, e.g. when only an error has been seen so far
+static constexpr uint32_t kUnknownState = UINT32_MAX;
+
+// How often a reader retries a slot that keeps changing before giving up
+static constexpr uint32_t kMaxSpins = 10000;
+
+struct StateBoard::Slot {
+    std::atomic<uint32_t> state; // SlotState
+    char callsign[kCallsignLength];
+    std::atomic<uint64_t> sequence; // Low half odd while being written, high half the PID of the last writer
+    std::atomic<uint32_t> pluginState;
+    std::atomic<uint32_t> error;
+    std::atomic<uint64_t> changedUs;
+};
+
+/**
+ * @brief Layout of the state board file. All zeroes is a valid, empty board
+ */
+struct StateBoard::Store {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t reserved;
+    std::atomic<uint64_t> dropped;
+    Slot slots[kMaxPlugins];
+};
+
+/**
+ * @brief The state a plugin is in once the operation has succeeded
+ */
+static uint32_t stateAfter(const IPluginStarter::Operation operation)
+{
+    switch (operation) {
+    case IPluginStarter::Operation::Deactivate:
+        return PluginHost::IShell::DEACTIVATED;
+    case IPluginStarter::Operation::Hibernate:
+        return PluginHost::IShell::HIBERNATED;
+    case IPluginStarter::Operation::Activate:
+    case IPluginStarter::Operation::Resume:
+        break;
+    }
+    return PluginHost::IShell::ACTIVATED;
+}
+
+StateBoard::StateBoard()
+    : _store(nullptr)
+    , _writable(false)
+{
+}
+
+StateBoard::~StateBoard()
+{
+    if (_store != nullptr) {
+        munmap(_store, sizeof(Store));
+    }
+}
+
+StateBoard& StateBoard::instance()
+{
+    static StateBoard board;
+    return board;
+}
+
+/**
+ * @brief Map the state board file
+ *
+ * @param[in]   path        Board file, created if it doesn't exist yet when writable
+ * @param[in]   writable    False to only read the board, which only needs read access to the file
+ */
+bool StateBoard::open(const std::string& path, const bool writable)
+{
+    int fd = ::open(path.c_str(), writable ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+    if (fd < 0) {
+        LOG_ERROR("Board", "Cannot open state board %s (%s)", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    bool valid = (fstat(fd, &info) == 0);
+
+    // Only one process sizes and stamps a new file
+    if (writable) {
+        flock(fd, LOCK_EX);
+
+        if (valid && info.st_size == 0 && ftruncate(fd, sizeof(Store)) != 0) {
+            valid = false;
+        }
+    } else if (valid && info.st_size < static_cast<off_t>(sizeof(Store))) {
+        valid = false;
+        errno = EINVAL;
+    }
+
+    void* mapping = MAP_FAILED;
+    if (valid) {
+        mapping = mmap(nullptr, sizeof(Store), writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    }
+
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("Board", "Cannot map state board %s (%s)", path.c_str(), strerror(errno));
+        if (writable) {
+            flock(fd, LOCK_UN);
+        }
+        close(fd);
+        return false;
+    }
+
+    Store* store = static_cast<Store*>(mapping);
+
+    if (writable) {
+        if (store->magic == 0) {
+            store->version = kVersion;
+            store->size = sizeof(Store);
+            store->magic = kMagic;
+        }
+        flock(fd, LOCK_UN);
+    }
+
+    close(fd);
+
+    if (store->magic != kMagic || store->version != kVersion || store->size != sizeof(Store)) {
+        LOG_ERROR("Board", "%s is not a state board of this version, remove it to start over", path.c_str());
+        munmap(mapping, sizeof(Store));
+        return false;
+    }
+
+    _store = store;
+    _writable = writable;
+    return true;
+}
+
+/**
+ * @brief Record the state a plugin is in, the timestamp only moves if the state changed
+ */
+void StateBoard::publishState(const std::string& callsign, const uint32_t state)
+{
+    update(callsign, [state](Slot& slot) {
+        if (slot.pluginState.load(std::memory_order_relaxed) != state) {
+            slot.pluginState.store(state, std::memory_order_relaxed);
+            slot.changedUs.store(ActivationTrace::now(), std::memory_order_relaxed);
+        }
+    });
+}
+
+/**
+ * @brief Record the result of an operation on a plugin: its new state if it succeeded, the error if not
+ */
+void StateBoard::publishResult(const std::string& callsign, const IPluginStarter::Operation operation, const uint32_t result)
+{
+    if (result == Core::ERROR_NONE) {
+        publishState(callsign, stateAfter(operation));
+        return;
+    }
+
+    update(callsign, [result](Slot& slot) {
+        slot.error.store(result, std::memory_order_relaxed);
+    });
+}
+
+/**
+ * @brief Apply a change to the plugin's slot, claiming one if needed, under the slot's sequence lock
+ */
+template <typename UPDATE>
+void StateBoard::update(const std::string& callsign, const UPDATE& change)
+{
+    if (_store == nullptr || !_writable) {
+        return;
+    }
+
+    char name[kCallsignLength] = {};
+    strncpy(name, callsign.c_str(), kCallsignLength - 1);
+
+    const int32_t index = claimSlot(
+        _store->slots, kMaxPlugins, hashName(name),
+        [&name](const Slot& slot) { return strncmp(slot.callsign, name, kCallsignLength) == 0; },
+        [&name](Slot& slot) {
+            memcpy(slot.callsign, name, kCallsignLength);
+            slot.pluginState.store(kUnknownState, std::memory_order_relaxed);
+        });
+
+    if (index < 0) {
+        _store->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Slot& slot = _store->slots[index];
+
+    // Another activator may be updating the same plugin, wait for its sequence to go even and take it. Every
+    // kSharedSlotSpins check whether the writer still exists, if it died mid-update the slot is taken over by
+    // moving the sequence on to the next odd value instead. A writer that is merely slow keeps the slot
+    const uint64_t self = static_cast<uint64_t>(getpid()) << 32;
+    uint64_t word = slot.sequence.load(std::memory_order_relaxed);
+    uint32_t sequence = 0;
+    uint32_t spins = 0;
+
+    while (true) {
+        sequence = static_cast<uint32_t>(word);
+
+        if ((sequence & 1) == 0) {
+            if (slot.sequence.compare_exchange_weak(word, self | (sequence + 1), std::memory_order_acquire, std::memory_order_relaxed)) {
+                // Readers must see the sequence go odd before any of the data changes
+                std::atomic_thread_fence(std::memory_order_release);
+                sequence++;
+                break;
+            }
+            spins = 0;
+            continue;
+        }
+
+        if (++spins >= kSharedSlotSpins) {
+            spins = 0;
+
+            if (ownerDied(static_cast<pid_t>(word >> 32))) {
+                if (slot.sequence.compare_exchange_strong(word, self | (sequence + 2), std::memory_order_acquire, std::memory_order_relaxed)) {
+                    std::atomic_thread_fence(std::memory_order_release);
+                    LOG_WARN(callsign.c_str(), "State board slot was left locked by a process that died, taking it over");
+                    sequence += 2;
+                    break;
+                }
+                continue;
+            }
+        }
+
+        sched_yield();
+
+        const uint64_t current = slot.sequence.load(std::memory_order_relaxed);
+        if (current != word) {
+            spins = 0;
+        }
+        word = current;
+    }
+
+    change(slot);
+
+    slot.sequence.store(self | (sequence + 1), std::memory_order_release);
+}
+
+/**
+ * @brief Take a consistent copy of a slot, retrying while it is being written
+ *
+ * @return False if the slot could not be read consistently
+ */
+bool StateBoard::readSlot(const Slot& slot, Entry& entry)
+{
+    for (uint32_t spin = 0; spin < kMaxSpins; spin++) {
+        const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+
+        if ((before & 1) == 0) {
+            entry.state = slot.pluginState.load(std::memory_order_relaxed);
+            entry.changedUs = slot.changedUs.load(std::memory_order_relaxed);
+            entry.error = slot.error.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (slot.sequence.load(std::memory_order_relaxed) == before) {
+                entry.callsign.assign(slot.callsign, strnlen(slot.callsign, kCallsignLength));
+                return true;
+            }
+        }
+
+        sched_yield();
+    }
+
+    return false;
+}
+
+/**
+ * @brief Look up a plugin on the board
+ *
+ * @return False if nothing has been published for the plugin
+ */
+bool StateBoard::read(const std::string& callsign, Entry& entry) const
+{
+    if (_store == nullptr) {
+        return false;
+    }
+
+    char name[kCallsignLength] = {};
+    strncpy(name, callsign.c_str(), kCallsignLength - 1);
+
+    const int32_t index = findSlot(_store->slots, kMaxPlugins, hashName(name), [&name](const Slot& slot) {
+        return strncmp(slot.callsign, name, kCallsignLength) == 0;
+    });
+
+    return index >= 0 && readSlot(_store->slots[index], entry);
+}
+
+/**
+ * @brief Every plugin on the board
+ */
+std::vector<StateBoard::Entry> StateBoard::entries() const
+{
+    std::vector<Entry> entries;
+
+    if (_store == nullptr) {
+        return entries;
+    }
+
+    for (const Slot& slot : _store->slots) {
+        Entry entry;
+
+        if (slot.state.load(std::memory_order_acquire) == Used && readSlot(slot, entry)) {
+            entries.push_back(entry);
+        }
+    }
+
+    return entries;
+}
@@ -0,0 +1,84 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "IPluginStarter.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Plugin states published in shared memory, so anyone can check on a plugin without asking Thunder
+ *
+ * The activator records each plugin's state, when it last changed and the last error an operation on it
+ * failed with in a fixed size, memory-mapped file. Every activator given the same file publishes to it:
+ * the results of its own operations as well as every state change it is notified of by the controller.
+ *
+ * Each slot is protected by a sequence lock. Writers (from any process) take turns on a slot by making its
+ * sequence odd; readers never write, so they can map the file read-only, and simply retry if the sequence
+ * changed while they were reading. Once mapped, a lookup is a hash probe and a few loads - no locks and
+ * no system calls. The sequence also records the writer's PID, so a slot left locked by a writer that died
+ * mid-update is taken over by the next writer once it sees that process is gone, until then readers report
+ * the plugin as unknown.
+ *
+ * Timestamps are CLOCK_MONOTONIC, in microseconds, like the timing traces
+ */
+class StateBoard {
+public:
+    struct Entry {
+        std::string callsign;
+        uint32_t state; // PluginHost::IShell::state, UINT32_MAX if only an error has been seen so far
+        uint64_t changedUs;
+        uint32_t error; // Last error, ERROR_NONE if none
+    };
+
+public:
+    static StateBoard& instance();
+
+    bool open(const std::string& path, const bool writable = true);
+    bool enabled() const { return _store != nullptr; }
+
+    void publishState(const std::string& callsign, const uint32_t state);
+    void publishResult(const std::string& callsign, const IPluginStarter::Operation operation, const uint32_t result);
+
+    bool read(const std::string& callsign, Entry& entry) const;
+    std::vector<Entry> entries() const;
+
+private:
+    struct Store;
+    struct Slot;
+
+private:
+    StateBoard();
+    ~StateBoard();
+
+    StateBoard(const StateBoard&) = delete;
+    StateBoard& operator=(const StateBoard&) = delete;
+
+    template <typename UPDATE>
+    void update(const std::string& callsign, const UPDATE& change);
+
+    static bool readSlot(const Slot& slot, Entry& entry);
+
+private:
+    Store* _store;
+    bool _writable;
+};
@@ -0,0 +1,245 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StateWaiter.h"
+
+#include "ActivationTrace.h"
+#include "Log.h"
+#include "StateBoard.h"
+
+#include <chrono>
+
+StateWaiter::StateWaiter()
+    : _connector(*this)
+    , _notification(*this)
+    , _lock()
+    , _changed()
+    , _states()
+    , _connected(false)
+{
+}
+
+StateWaiter::~StateWaiter()
+{
+    if (_connector.IsOperational() == true) {
+        _connector.Close(RPC::CommunicationTimeOut);
+    }
+}
+
+void StateWaiter::Connector::Operational(const bool upAndRunning)
+{
+    _parent.onOperational(upAndRunning);
+}
+
+void StateWaiter::Notification::StateChange(const string& callsign, const PluginHost::IShell::state& state, const PluginHost::IShell::reason& reason VARIABLE_IS_NOT_USED)
+{
+    StateBoard::instance().publishState(callsign, state);
+    _parent.onStateChange(callsign, state);
+}
+
+bool StateWaiter::parseState(const char* name, PluginHost::IShell::state& state)
+{
+    if (strcmp(name, "activated") == 0) {
+        state = PluginHost::IShell::ACTIVATED;
+    } else if (strcmp(name, "deactivated") == 0) {
+        state = PluginHost::IShell::DEACTIVATED;
+    } else if (strcmp(name, "unavailable") == 0) {
+        state = PluginHost::IShell::UNAVAILABLE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* StateWaiter::stateName(const PluginHost::IShell::state state)
+{
+    switch (state) {
+    case PluginHost::IShell::ACTIVATED:
+        return "activated";
+    case PluginHost::IShell::DEACTIVATED:
+        return "deactivated";
+    case PluginHost::IShell::UNAVAILABLE:
+        return "unavailable";
+    case PluginHost::IShell::ACTIVATION:
+        return "activating";
+    case PluginHost::IShell::DEACTIVATION:
+        return "deactivating";
+    case PluginHost::IShell::PRECONDITION:
+        return "waiting for preconditions";
+    case PluginHost::IShell::HIBERNATED:
+        return "hibernated";
+    default:
+        return "unknown";
+    }
+}
+
+/**
+ * @brief Wait until every plugin is in the target state
+ *
+ * @param[in]   callsigns   Plugins to wait for
+ * @param[in]   target      State they must all be in
+ * @param[in]   timeoutMs   How long to wait, 0 to wait for ever
+ *
+ * @return True if all plugins reached the state, false on timeout, unknown plugins or losing Thunder
+ */
+bool StateWaiter::wait(const std::vector<string>& callsigns, const PluginHost::IShell::state target, const uint32_t timeoutMs)
+{
+    ActivationTrace::Scope trace("wait", string());
+
+    const uint32_t result = _connector.Open(RPC::CommunicationTimeOut, ControllerConnector::Connector());
+    if (result != Core::ERROR_NONE) {
+        LOG_ERROR("Wait", "Failed to connect to the controller, error %u (%s)", result, Core::ErrorToString(result));
+        trace.result(result);
+        return false;
+    }
+
+    Exchange::Controller::ILifeTime* lifetime = _connector.Interface();
+    if (lifetime == nullptr) {
+        LOG_ERROR("Wait", "Failed to get the ILifeTime interface");
+        trace.result(Core::ERROR_UNAVAILABLE);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _connected = true;
+    }
+
+    // Register before reading the current states, so a change in between can't be missed
+    const bool registered = (lifetime->Register(&_notification) == Core::ERROR_NONE);
+    bool success = registered && readStates(lifetime, callsigns);
+
+    if (registered == false) {
+        LOG_ERROR("Wait", "Failed to register for plugin state changes");
+    }
+
+    if (success == true) {
+        std::unique_lock<std::mutex> lock(_lock);
+
+        auto done = [this, &callsigns, target]() { return _connected == false || reached(callsigns, target); };
+
+        if (timeoutMs == 0) {
+            _changed.wait(lock, done);
+        } else {
+            _changed.wait_for(lock, std::chrono::milliseconds(timeoutMs), done);
+        }
+
+        success = reached(callsigns, target);
+
+        if (success == false) {
+            for (const string& callsign : callsigns) {
+                auto state = _states.find(callsign);
+                if (state == _states.end() || state->second != target) {
+                    LOG_ERROR(callsign.c_str(), "Plugin is %s, not %s", (state != _states.end()) ? stateName(state->second) : "unknown", stateName(target));
+                }
+            }
+            if (_connected == false) {
+                LOG_ERROR("Wait", "Lost the connection to Thunder");
+            } else {
+                LOG_ERROR("Wait", "Timed out after %ums", timeoutMs);
+            }
+        }
+    }
+
+    if (registered == true) {
+        lifetime->Unregister(&_notification);
+    }
+    lifetime->Release();
+
+    trace.result(success ? Core::ERROR_NONE : Core::ERROR_TIMEDOUT);
+    return success;
+}
+
+/**
+ * @brief Read the current state of each plugin from the controller's metadata
+ *
+ * States already reported through a notification are newer and are kept
+ *
+ * @return False if one of the plugins is not known to Thunder
+ */
+bool StateWaiter::readStates(Exchange::Controller::ILifeTime* lifetime, const std::vector<string>& callsigns)
+{
+    Exchange::Controller::IMetadata* metadata = lifetime->QueryInterface<Exchange::Controller::IMetadata>();
+    if (metadata == nullptr) {
+        LOG_WARN("Wait", "Controller metadata is not available, relying on state changes only");
+        return true;
+    }
+
+    bool known = true;
+
+    for (const string& callsign : callsigns) {
+        Exchange::Controller::IMetadata::Data::IServicesIterator* services = nullptr;
+        Exchange::Controller::IMetadata::Data::Service service;
+        bool found = false;
+
+        if (metadata->Services(callsign, services) == Core::ERROR_NONE && services != nullptr) {
+            found = services->Next(service);
+            services->Release();
+        }
+
+        if (found == false) {
+            LOG_ERROR(callsign.c_str(), "Plugin is not known to Thunder");
+            known = false;
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(_lock);
+        if (_states.find(callsign) == _states.end()) {
+            _states[callsign] = service.State;
+            StateBoard::instance().publishState(callsign, service.State);
+            LOG_DBG(callsign.c_str(), "Plugin is %s", stateName(service.State));
+        }
+    }
+
+    metadata->Release();
+    return known;
+}
+
+/**
+ * @brief Whether all the plugins are in the target state. Must be called with the lock held
+ */
+bool StateWaiter::reached(const std::vector<string>& callsigns, const PluginHost::IShell::state target) const
+{
+    for (const string& callsign : callsigns) {
+        auto state = _states.find(callsign);
+        if (state == _states.end() || state->second != target) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StateWaiter::onStateChange(const string& callsign, const PluginHost::IShell::state state)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    LOG_DBG(callsign.c_str(), "Plugin is now %s", stateName(state));
+    _states[callsign] = state;
+    _changed.notify_all();
+}
+
+void StateWaiter::onOperational(const bool operational)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    if (operational == false) {
+        _connected = false;
+        _changed.notify_all();
+    }
+}
@@ -0,0 +1,107 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "Module.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using namespace WPEFramework;
+
+/**
+ * @brief Blocks until plugins reach a given state, without activating anything
+ *
+ * Gives services outside Thunder an exact synchronisation point on plugins they depend on. Registers
+ * for plugin state changes on the controller connection, then reads the current state of each plugin
+ * from the controller's metadata, so a state reached before or after registering is never missed and
+ * nothing is polled
+ */
+class StateWaiter {
+public:
+    StateWaiter();
+    ~StateWaiter();
+
+    StateWaiter(const StateWaiter&) = delete;
+    StateWaiter& operator=(const StateWaiter&) = delete;
+
+    bool wait(const std::vector<string>& callsigns, const PluginHost::IShell::state target, const uint32_t timeoutMs);
+
+    static bool parseState(const char* name, PluginHost::IShell::state& state);
+    static const char* stateName(const PluginHost::IShell::state state);
+
+private:
+    using ControllerConnector = RPC::SmartControllerInterfaceType<Exchange::Controller::ILifeTime>;
+
+    class Connector : public ControllerConnector {
+    public:
+        explicit Connector(StateWaiter& parent)
+            : _parent(parent)
+        {
+        }
+        ~Connector() override = default;
+
+        Connector(const Connector&) = delete;
+        Connector& operator=(const Connector&) = delete;
+
+        void Operational(const bool upAndRunning) override;
+
+    private:
+        StateWaiter& _parent;
+    };
+
+    class Notification : public Exchange::Controller::ILifeTime::INotification {
+    public:
+        explicit Notification(StateWaiter& parent)
+            : _parent(parent)
+        {
+        }
+        ~Notification() override = default;
+
+        Notification(const Notification&) = delete;
+        Notification& operator=(const Notification&) = delete;
+
+        void StateChange(const string& callsign, const PluginHost::IShell::state& state, const PluginHost::IShell::reason& reason) override;
+
+        BEGIN_INTERFACE_MAP(Notification)
+        INTERFACE_ENTRY(Exchange::Controller::ILifeTime::INotification)
+        END_INTERFACE_MAP
+
+    private:
+        StateWaiter& _parent;
+    };
+
+private:
+    bool readStates(Exchange::Controller::ILifeTime* lifetime, const std::vector<string>& callsigns);
+    bool reached(const std::vector<string>& callsigns, const PluginHost::IShell::state target) const;
+
+    void onStateChange(const string& callsign, const PluginHost::IShell::state state);
+    void onOperational(const bool operational);
+
+private:
+    Connector _connector;
+    Core::Sink<Notification> _notification;
+
+    mutable std::mutex _lock;
+    std::condition_variable _changed;
+    std::map<string, PluginHost::IShell::state> _states;
+    bool _connected;
+};
@@ -20,36 +20,217 @@
 #include "Module.h"
 
 #include "Log.h"
+#include "ActivationEngine.h"
+#include "ActivationHistory.h"
+#include "ActivationMetrics.h"
+#include "ActivationTrace.h"
+#include "AdmissionControl.h"
+#include "ActivatorClient.h"
+#include "ActivatorDaemon.h"
 #include "COMRPCStarter.h"
+#include "CallWatchdog.h"
+#include "JSONRPCStarter.h"
+#include "Manifest.h"
+#include "PluginSnapshot.h"
+#include "PluginSupervisor.h"
+#include "ProcessDiscovery.h"
+#include "StateBoard.h"
+#include "StateWaiter.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
 #include <memory>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
 
 static int gRetryCount = 100;
 static int gRetryDelayMs = 500;
-static string gPluginName;
+static int gMaxRetryDelayMs = 0;
+static int gDeadlineMs = 0;
+static int gRunDeadlineMs = 0;
+static int gCallTimeoutMs = 0;
+static RetryPolicy::Backoff gBackoff = RetryPolicy::Backoff::Fixed;
+static std::vector<string> gCallsigns;
+static std::vector<std::pair<string, string>> gDependencies;
+static int gJobs = 1;
+static bool gJobsSet = false;
+static uint32_t gRetrySettings = 0; // Manifest::RetrySetting flags for the retry options given explicitly
+static string gManifestPath;
+static string gHistoryPath;
+static string gMetricsPath;
+static string gBoardPath;
+static bool gExportMetrics = false;
+static string gSnapshotPath;
+static bool gRestore = false;
+static AdmissionControl::Limits gAdmissionLimits;
+
+// Restoring after a Thunder restart: bring the plugins back concurrently, and give Thunder time to come up
+static constexpr int kRestoreJobs = 8;
+static constexpr int kRestoreThunderWaitMs = 60000;
+
+// How long calls abandoned by the watchdog are given to return before exiting
+static constexpr uint32_t kAbandonedCallWaitMs = 2000;
+
+static std::map<string, ActivationEngine::PluginOptions> gPluginOptions;
+static int gThunderTimeoutMs = 0;
 static int gLogLevel = LEVEL_INFO;
 
-static bool gDeactivate = false;
+static IPluginStarter::Operation gOperation = IPluginStarter::Operation::Activate;
+static bool gSupervise = false;
+
+enum class Mode {
+    Direct,
+    Daemon,
+    Client,
+    Wait,
+    Snapshot,
+    Board
+};
+
+enum class Transport {
+    COMRPC,
+    JSONRPC
+};
+
+static Mode gMode = Mode::Direct;
+static Transport gTransport = Transport::COMRPC;
+static string gSocketPath = ActivatorDaemon::defaultSocketPath();
+static bool gStatus = false;
+static ActivatorDaemon* gDaemon = nullptr;
+static PluginSupervisor* gSupervisor = nullptr;
+static string gTracePath;
+static ActivationTrace::Format gTraceFormat = ActivationTrace::Format::Chrome;
+static LogTarget gLogTarget = LogTarget::Stderr;
+static PluginHost::IShell::state gWaitState = PluginHost::IShell::ACTIVATED;
 
 /**
  * @brief Display a help message for the tool
  */
 static void displayUsage()
 {
-    printf("Usage: PluginActivator <option(s)> [callsign]\n");
-    printf("    Utility that starts a given thunder plugin\n\n");
+    printf("Usage: PluginActivator <option(s)> [callsign...]\n");
+    printf("    Utility that starts the given thunder plugin(s)\n\n");
     printf("    -h, --help          Print this help and exit\n");
     printf("    -r, --retries       Maximum amount of retries to attempt to start the plugin before giving up\n");
+    printf("                        (0 for no limit, requires --deadline). Retries brought forward by controller\n");
+    printf("                        events don't count, up to as many again\n");
     printf("    -d, --delay         Delay (in ms) between each attempt to start the plugin if it fails\n");
+    printf("    -b, --backoff       How the delay changes between attempts: fixed (default), exponential or jitter\n");
+    printf("    -m, --max-delay     Upper bound (in ms) for the delay when using exponential or jitter backoff\n");
+    printf("                        (default 16x the delay)\n");
+    printf("    -T, --deadline      Give up after this long (in ms) regardless of the number of retries (default none)\n");
+    printf("    -O, --run-deadline  Give up on every plugin still outstanding after this long (in ms) (default none)\n");
+    printf("    -C, --call-timeout  Count an attempt as failed if its call has not returned after this long (in ms)\n");
+    printf("                        instead of waiting on it indefinitely (default none)\n");
     printf("    -v, --verbose       Increase log level\n");
-    printf("    -x, --deactivate    Deactivate the plugin instead of activating\n");
+    printf("    -x, --deactivate    Deactivate the plugin instead of activating. Dependencies are followed in reverse\n");
+    printf("    -z, --hibernate     Hibernate the (out-of-process) plugin instead of activating, freeing its memory.\n");
+    printf("                        Dependencies are followed in reverse\n");
+    printf("    -a, --resume        Wake the plugin from hibernation (or resume it if suspended) instead of activating\n");
+    printf("    -f, --file          Read callsigns from a file, one or more per line ('-' for stdin)\n");
+    printf("    -j, --jobs          Maximum number of plugins to activate in parallel (default 1)\n");
+    printf("    -M, --manifest      Load plugins, dependencies, priorities and retry settings from a JSON manifest\n");
+    printf("    -H, --history       Remember activation times in the given file and use them to order activations\n");
+    printf("                        and fit each plugin's retry delay and deadline\n");
+    printf("    -E, --metrics       Add counters and latency histograms to the given shared metrics file\n");
+    printf("    -B, --board         Publish plugin states to the given shared state board file\n");
+    printf("    -X, --prometheus    Print the --metrics file in Prometheus text format and exit\n");
+    printf("    -k, --snapshot      Save the callsigns of all currently activated plugins to the given file and exit\n");
+    printf("    -R, --restore       Activate the plugins saved with --snapshot, in parallel, waiting for Thunder to start\n");
+    printf("    -A, --admission     Hold activations back to one at a time while the system is under pressure, given as\n");
+    printf("                        <limit>=<value>[,...]: available=<MB> (minimum MemAvailable), memory=<%%>, cpu=<%%>\n");
+    printf("                        and io=<%%> (maximum pressure stall avg10)\n");
+    printf("    -D, --depends       Activation dependency in the form <callsign>=<dependency>[,<dependency>...]\n");
+    printf("                        The plugin is only activated once all its dependencies have activated\n");
+    printf("    -t, --thunder-wait  Time (in ms) to wait for Thunder to start if it is not running yet (default 0)\n");
+    printf("    -s, --daemon        Stay resident and serve requests on a unix socket (supports systemd socket activation)\n");
+    printf("    -c, --client        Forward the request to a running daemon instead of talking to Thunder directly\n");
+    printf("    -S, --socket        Path of the daemon socket (default %s)\n", ActivatorDaemon::defaultSocketPath());
+    printf("    -q, --status        With --client, query the daemon for the status of the given plugins (or of the daemon).\n");
+    printf("                        With --board, read the state of the given plugins (or all) from the board\n");
+    printf("    -P, --transport     How to talk to Thunder: comrpc (default) or jsonrpc\n");
+    printf("    -o, --trace         Append a per-phase timing trace to the given file\n");
+    printf("    -F, --trace-format  Format of the trace: chrome (trace-event format, default) or json (JSON lines)\n");
+    printf("    -L, --log-target    Where to log: stderr (default) or journal (structured records to the systemd journal)\n");
+    printf("    -w, --wait          Don't activate anything, wait until the plugin(s) are activated, deactivated or\n");
+    printf("                        unavailable. --deadline bounds the wait (default for ever)\n");
+    printf("    -u, --supervise     Stay resident after activating and re-activate plugins that crash, backing off\n");
+    printf("                        and giving up on plugins that keep crashing\n");
     printf("\n");
-    printf("    [callsign]          Callsign of the plugin to activate (Required)\n");
+    printf("    [callsign...]       Callsign(s) of the plugin(s) to activate (Required unless --file is given)\n");
+    printf("                        With the default of one job they are handled one at a time over a single Thunder\n");
+    printf("                        connection, in the order given unless dependencies or priorities say otherwise.\n");
+    printf("                        With --jobs, each parallel worker has its own connection\n");
+}
+
+/**
+ * @brief Read a list of callsigns from a file (or stdin if path is "-")
+ *
+ * Callsigns are whitespace separated, blank lines and anything after a '#' are ignored
+ *
+ * @return False if the file could not be opened
+ */
+static bool readCallsignList(const char* path)
+{
+    std::ifstream file;
+    std::istream* input = &std::cin;
+
+    if (strcmp(path, "-") != 0) {
+        file.open(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        input = &file;
+    }
+
+    string line;
+    while (std::getline(*input, line)) {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream tokens(line);
+        string callsign;
+        while (tokens >> callsign) {
+            gCallsigns.push_back(callsign);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Parse a dependency argument of the form <callsign>=<dependency>[,<dependency>...]
+ *
+ * @return False if the argument is malformed
+ */
+static bool parseDependency(const char* argument)
+{
+    const string value(argument);
+    const size_t separator = value.find('=');
+
+    if (separator == string::npos || separator == 0 || separator == value.size() - 1) {
+        return false;
+    }
+
+    const string callsign = value.substr(0, separator);
+    std::istringstream dependencies(value.substr(separator + 1));
+
+    string dependency;
+    while (std::getline(dependencies, dependency, ',')) {
+        if (!dependency.empty()) {
+            gDependencies.emplace_back(callsign, dependency);
+        }
+    }
+
+    return true;
 }
 
 /**
  * @brief Parse the provided command line arguments
  *
- * Must be given the name of the plugin to activate, everything else
+ * Must be given the name of at least one plugin to activate, everything else
  * is optional and will fallback to sane defaults
  */
 static void parseArgs(const int argc, char** argv)
@@ -63,8 +244,37 @@ static void parseArgs(const int argc, char** argv)
         { "help", no_argument, nullptr, (int)'h' },
         { "retries", required_argument, nullptr, (int)'r' },
         { "delay", required_argument, nullptr, (int)'d' },
+        { "backoff", required_argument, nullptr, (int)'b' },
+        { "max-delay", required_argument, nullptr, (int)'m' },
+        { "deadline", required_argument, nullptr, (int)'T' },
+        { "run-deadline", required_argument, nullptr, (int)'O' },
+        { "call-timeout", required_argument, nullptr, (int)'C' },
         { "verbose", no_argument, nullptr, (int)'v' },
         { "deactivate", no_argument, nullptr, (int)'x' },
+        { "hibernate", no_argument, nullptr, (int)'z' },
+        { "resume", no_argument, nullptr, (int)'a' },
+        { "file", required_argument, nullptr, (int)'f' },
+        { "jobs", required_argument, nullptr, (int)'j' },
+        { "manifest", required_argument, nullptr, (int)'M' },
+        { "history", required_argument, nullptr, (int)'H' },
+        { "depends", required_argument, nullptr, (int)'D' },
+        { "admission", required_argument, nullptr, (int)'A' },
+        { "metrics", required_argument, nullptr, (int)'E' },
+        { "board", required_argument, nullptr, (int)'B' },
+        { "snapshot", required_argument, nullptr, (int)'k' },
+        { "restore", required_argument, nullptr, (int)'R' },
+        { "prometheus", no_argument, nullptr, (int)'X' },
+        { "thunder-wait", required_argument, nullptr, (int)'t' },
+        { "daemon", no_argument, nullptr, (int)'s' },
+        { "client", no_argument, nullptr, (int)'c' },
+        { "socket", required_argument, nullptr, (int)'S' },
+        { "status", no_argument, nullptr, (int)'q' },
+        { "transport", required_argument, nullptr, (int)'P' },
+        { "trace", required_argument, nullptr, (int)'o' },
+        { "trace-format", required_argument, nullptr, (int)'F' },
+        { "log-target", required_argument, nullptr, (int)'L' },
+        { "wait", required_argument, nullptr, (int)'w' },
+        { "supervise", no_argument, nullptr, (int)'u' },
         { nullptr, 0, nullptr, 0 }
     };
 
@@ -73,7 +283,7 @@ static void parseArgs(const int argc, char** argv)
     int option;
     int longindex;
 
-    while ((option = getopt_long(argc, argv, "hr:d:v:x", longopts, &longindex)) != -1) {
+    while ((option = getopt_long(argc, argv, "hr:d:b:m:T:O:C:vxzaf:j:M:H:D:A:E:B:Xk:R:t:scS:qP:o:F:L:w:u", longopts, &longindex)) != -1) {
         switch (option) {
         case 'h':
             displayUsage();
@@ -85,6 +295,7 @@ static void parseArgs(const int argc, char** argv)
                 fprintf(stderr, "Error: Retry count must be > 0\n");
                 exit(EXIT_FAILURE);
             }
+            gRetrySettings |= Manifest::RetryAttempts;
             break;
         case 'd':
             gRetryDelayMs = std::atoi(optarg);
@@ -92,6 +303,30 @@ static void parseArgs(const int argc, char** argv)
                 fprintf(stderr, "Error: Delay ms must be > 0\n");
                 exit(EXIT_FAILURE);
             }
+            gRetrySettings |= Manifest::RetryDelay;
+            break;
+        case 'b':
+            if (!RetryPolicy::parseBackoff(optarg, gBackoff)) {
+                fprintf(stderr, "Error: Unknown backoff '%s', expected fixed, exponential or jitter\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            gRetrySettings |= Manifest::RetryBackoff;
+            break;
+        case 'm':
+            gMaxRetryDelayMs = std::atoi(optarg);
+            if (gMaxRetryDelayMs < 0) {
+                fprintf(stderr, "Error: Max delay ms must be > 0\n");
+                exit(EXIT_FAILURE);
+            }
+            gRetrySettings |= Manifest::RetryMaxDelay;
+            break;
+        case 'T':
+            gDeadlineMs = std::atoi(optarg);
+            if (gDeadlineMs < 0) {
+                fprintf(stderr, "Error: Deadline ms must be > 0\n");
+                exit(EXIT_FAILURE);
+            }
+            gRetrySettings |= Manifest::RetryDeadline;
             break;
         case 'v':
             if (gLogLevel < LEVEL_DEBUG) {
@@ -99,7 +334,134 @@ static void parseArgs(const int argc, char** argv)
             }
             break;
         case 'x':
-            gDeactivate = true;
+            gOperation = IPluginStarter::Operation::Deactivate;
+            break;
+        case 'z':
+            gOperation = IPluginStarter::Operation::Hibernate;
+            break;
+        case 'a':
+            gOperation = IPluginStarter::Operation::Resume;
+            break;
+        case 'f':
+            if (!readCallsignList(optarg)) {
+                fprintf(stderr, "Error: Failed to read callsign list from %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            gJobs = std::atoi(optarg);
+            if (gJobs < 1 || gJobs > UINT8_MAX) {
+                fprintf(stderr, "Error: Jobs must be between 1 and %d\n", UINT8_MAX);
+                exit(EXIT_FAILURE);
+            }
+            gJobsSet = true;
+            break;
+        case 'M':
+            gManifestPath = optarg;
+            break;
+        case 'H':
+            gHistoryPath = optarg;
+            break;
+        case 'E':
+            gMetricsPath = optarg;
+            break;
+        case 'B':
+            gBoardPath = optarg;
+            break;
+        case 'X':
+            gExportMetrics = true;
+            break;
+        case 'k':
+            gSnapshotPath = optarg;
+            gMode = Mode::Snapshot;
+            break;
+        case 'R':
+            if (!readCallsignList(optarg)) {
+                fprintf(stderr, "Error: Failed to read snapshot from %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            gRestore = true;
+            break;
+        case 'O':
+            gRunDeadlineMs = std::atoi(optarg);
+            if (gRunDeadlineMs < 0) {
+                fprintf(stderr, "Error: Run deadline ms must be >= 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'C':
+            gCallTimeoutMs = std::atoi(optarg);
+            if (gCallTimeoutMs < 0) {
+                fprintf(stderr, "Error: Call timeout ms must be >= 0\n");
+                exit(EXIT_FAILURE);
+            }
+            gRetrySettings |= Manifest::RetryCallTimeout;
+            break;
+        case 't':
+            gThunderTimeoutMs = std::atoi(optarg);
+            if (gThunderTimeoutMs < 0) {
+                fprintf(stderr, "Error: Thunder wait ms must be > 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            gMode = Mode::Daemon;
+            break;
+        case 'c':
+            gMode = Mode::Client;
+            break;
+        case 'S':
+            gSocketPath = optarg;
+            break;
+        case 'q':
+            gStatus = true;
+            break;
+        case 'P':
+            if (strcmp(optarg, "comrpc") == 0) {
+                gTransport = Transport::COMRPC;
+            } else if (strcmp(optarg, "jsonrpc") == 0) {
+                gTransport = Transport::JSONRPC;
+            } else {
+                fprintf(stderr, "Error: Unknown transport '%s', expected comrpc or jsonrpc\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'o':
+            gTracePath = optarg;
+            break;
+        case 'F':
+            if (!ActivationTrace::parseFormat(optarg, gTraceFormat)) {
+                fprintf(stderr, "Error: Unknown trace format '%s', expected chrome or json\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'L':
+            if (!parseLogTarget(optarg, gLogTarget)) {
+                fprintf(stderr, "Error: Unknown log target '%s', expected stderr or journal\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'D':
+            if (!parseDependency(optarg)) {
+                fprintf(stderr, "Error: Invalid dependency '%s', expected <callsign>=<dependency>[,<dependency>...]\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'A':
+            if (!AdmissionControl::parseLimits(optarg, gAdmissionLimits)) {
+                fprintf(stderr, "Error: Invalid admission limits '%s', expected <limit>=<value>[,...] with available, memory, cpu or io\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'w':
+            if (!StateWaiter::parseState(optarg, gWaitState)) {
+                fprintf(stderr, "Error: Unknown state '%s', expected activated, deactivated or unavailable\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            gMode = Mode::Wait;
+            break;
+        case 'u':
+            gSupervise = true;
             break;
         case '?':
             if (optopt == 'c')
@@ -117,85 +479,484 @@ static void parseArgs(const int argc, char** argv)
         }
     }
 
-    if (optind == argc) {
+    for (int i = optind; i < argc; i++) {
+        gCallsigns.push_back(argv[i]);
+    }
+
+    if (gExportMetrics) {
+        if (gMetricsPath.empty()) {
+            fprintf(stderr, "Error: --prometheus requires --metrics\n");
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+
+    if (gStatus && gMode == Mode::Direct && !gBoardPath.empty()) {
+        gMode = Mode::Board;
+        return;
+    }
+
+    if (gStatus && gMode != Mode::Client) {
+        fprintf(stderr, "Error: --status requires --client or --board\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (gRestore) {
+        if (!gJobsSet) {
+            gJobs = std::max<int>(1, std::min<int>(gCallsigns.size(), kRestoreJobs));
+        }
+        if (gThunderTimeoutMs == 0) {
+            gThunderTimeoutMs = kRestoreThunderWaitMs;
+        }
+        if (gCallsigns.empty()) {
+            fprintf(stderr, "Snapshot is empty, nothing to restore\n");
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    // The daemon takes its callsigns from its clients, a status query may be for the daemon itself and a
+    // snapshot is of whatever is running
+    if (gCallsigns.empty() && gManifestPath.empty() && gMode != Mode::Daemon && gMode != Mode::Snapshot && !gStatus) {
         fprintf(stderr, "Error: Must provide plugin name to activate\n");
         exit(EXIT_FAILURE);
     }
 
-    gPluginName = argv[optind];
+    if (gMode == Mode::Wait && (gOperation != IPluginStarter::Operation::Activate || gTransport != Transport::COMRPC)) {
+        fprintf(stderr, "Error: --wait can't be combined with --deactivate, --hibernate or --resume and only supports the comrpc transport\n");
+        exit(EXIT_FAILURE);
+    }
 
-    optind++;
-    for (int i = optind; i < argc; i++) {
-        printf("Warning: Non-option argument %s ignored\n", argv[i]);
+    if (gMode == Mode::Snapshot && gTransport != Transport::COMRPC) {
+        fprintf(stderr, "Error: --snapshot only supports the comrpc transport\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (gSupervise && (gMode != Mode::Direct || gOperation != IPluginStarter::Operation::Activate || gTransport != Transport::COMRPC)) {
+        fprintf(stderr, "Error: --supervise only supports activating plugins directly over the comrpc transport\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (gRetryCount == 0 && gDeadlineMs == 0) {
+        fprintf(stderr, "Error: Unlimited retries require a deadline\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Merge the plugins, dependencies and settings from the manifest with those from the command line
+ *
+ * Options given explicitly on the command line win over the manifest, for the retry settings as for --jobs
+ *
+ * @param[in,out]   policy  Retry policy from the command line, with the manifest's settings applied
+ */
+static bool loadManifest(RetryPolicy& policy)
+{
+    Manifest manifest;
+
+    if (!manifest.load(gManifestPath, policy, gRetrySettings)) {
+        return false;
+    }
+
+    policy = manifest.policy();
+
+    // An explicit --jobs wins over the manifest
+    if (manifest.jobs() != 0 && !gJobsSet) {
+        gJobs = manifest.jobs();
+    }
+
+    for (const Manifest::Plugin& plugin : manifest.plugins()) {
+        if (std::find(gCallsigns.begin(), gCallsigns.end(), plugin.callsign) == gCallsigns.end()) {
+            gCallsigns.push_back(plugin.callsign);
+        }
+
+        ActivationEngine::PluginOptions& options = gPluginOptions[plugin.callsign];
+        options.priority = plugin.priority;
+        options.costMs = plugin.costMs;
+        options.hasPolicy = plugin.hasPolicy;
+        options.policy = plugin.policy;
+
+        for (const string& dependency : plugin.depends) {
+            gDependencies.emplace_back(plugin.callsign, dependency);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Options for activating a plugin, from the manifest and the plugin's activation history
+ *
+ * Anything set explicitly in the manifest is kept, the history only fills in the rest
+ */
+static ActivationEngine::PluginOptions pluginOptions(const string& callsign, const RetryPolicy& policy)
+{
+    ActivationEngine::PluginOptions options;
+
+    auto configured = gPluginOptions.find(callsign);
+    if (configured != gPluginOptions.end()) {
+        options = configured->second;
+    }
+
+    // The history only describes how plugins activate
+    ActivationHistory::Estimate estimate;
+    if (gOperation == IPluginStarter::Operation::Activate && ActivationHistory::instance().estimate(callsign, estimate)) {
+        if (options.costMs == 0) {
+            options.costMs = estimate.totalP50Ms;
+        }
+        if (!options.hasPolicy) {
+            options.hasPolicy = true;
+            options.policy = ActivationHistory::adapt(policy, estimate);
+        }
+
+        LOG_DBG(callsign.c_str(), "Usually activates in %ums (p95 %ums), using cost %ums, %ums delay, %ums deadline",
+            estimate.totalP50Ms, estimate.totalP95Ms, options.costMs, options.policy.delayMs(), options.policy.deadlineMs());
     }
+
+    return options;
 }
 
+/**
+ * @brief Create a starter for the transport selected on the command line
+ */
+static std::unique_ptr<IPluginStarter> createStarter()
+{
+    if (gTransport == Transport::JSONRPC) {
+        return std::unique_ptr<IPluginStarter>(new JSONRPCStarter(gCallTimeoutMs));
+    }
+    return std::unique_ptr<IPluginStarter>(new COMRPCStarter(gCallTimeoutMs));
+}
 
-uint32_t getPID(const char* processName)
+/**
+ * @brief Print the state of each callsign (or of every plugin) from the state board, without talking to Thunder
+ */
+static int runBoardQuery()
 {
-    char command[128] = {};
-    char buffer[128] = {};
-    uint32_t pid = 0;
+    if (!StateBoard::instance().open(gBoardPath, false)) {
+        return EXIT_FAILURE;
+    }
+
+    std::vector<StateBoard::Entry> entries;
+    bool success = true;
 
-    snprintf(command, sizeof(command), "pidof %s", processName);
-    FILE *fp = popen(command, "r");
-    if (!fp) {
-        fprintf(stderr, "popen for pidof %s failed\n", processName);
-        return 0;
+    if (gCallsigns.empty()) {
+        entries = StateBoard::instance().entries();
     }
-    if (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        pid = (uint32_t) atoi(buffer);
+
+    for (const string& callsign : gCallsigns) {
+        StateBoard::Entry entry;
+
+        if (StateBoard::instance().read(callsign, entry)) {
+            entries.push_back(entry);
+        } else {
+            printf("%s unknown\n", callsign.c_str());
+            success = false;
+        }
+    }
+
+    const uint64_t now = ActivationTrace::now();
+
+    for (const StateBoard::Entry& entry : entries) {
+        const char* state = (entry.state != UINT32_MAX) ? StateWaiter::stateName(static_cast<PluginHost::IShell::state>(entry.state)) : "unknown";
+
+        if (entry.state != UINT32_MAX) {
+            printf("%s %s for %llums", entry.callsign.c_str(), state, static_cast<unsigned long long>((now - entry.changedUs) / 1000));
+        } else {
+            printf("%s %s", entry.callsign.c_str(), state);
+        }
+        if (entry.error != Core::ERROR_NONE) {
+            printf(", last error %u (%s)", entry.error, Core::ErrorToString(entry.error));
+        }
+        printf("\n");
     }
-    pclose(fp);
-    return pid;
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-bool isRunning(uint32_t pid)
+/**
+ * @brief Forward the requested operation for each callsign to a running daemon
+ */
+static int runClient()
 {
-    if (pid == 0)
-        return false;
+    ActivatorClient client(gSocketPath);
+
+    if (!client.connect()) {
+        return EXIT_FAILURE;
+    }
+
+    const char* command = gStatus ? "status" : IPluginStarter::operationName(gOperation);
+    bool success = true;
+
+    std::vector<string> callsigns = gCallsigns;
+    if (callsigns.empty()) {
+        callsigns.push_back(string());
+    }
+
+    for (const string& callsign : callsigns) {
+        string response;
+
+        if (!client.request(callsign.empty() ? command : string(command) + " " + callsign, response)) {
+            return EXIT_FAILURE;
+        }
+
+        if (gStatus) {
+            printf("%s\n", response.c_str());
+        }
+
+        if (response.compare(0, 2, "OK") != 0) {
+            LOG_ERROR(callsign.c_str(), "Daemon reported: %s", response.c_str());
+            success = false;
+        }
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void stopDaemon(int signal VARIABLE_IS_NOT_USED)
+{
+    if (gDaemon != nullptr) {
+        gDaemon->stop();
+    }
+}
+
+/**
+ * @brief Tear down Thunder's singletons and return the exit status
+ *
+ * A call abandoned by the watchdog may still be blocked on its COM-RPC connection. Tearing down the
+ * singletons under it would crash the process, so if it does not return shortly the process exits
+ * straight away instead
+ */
+static int finish(const int status)
+{
+    if (!CallWatchdog::drain(kAbandonedCallWaitMs)) {
+        LOG_WARN("Watchdog", "Abandoned call(s) still blocked after %ums, exiting without cleaning up", kAbandonedCallWaitMs);
+        flushLogging();
+        _exit(status);
+    }
+
+    Core::Singleton::Dispose();
+    return status;
+}
+
+/**
+ * @brief Stay resident, serving activation requests over the daemon socket until signalled to stop
+ */
+static int runDaemon(const RetryPolicy& policy)
+{
+    bool success = false;
+
+    {
+        ActivatorDaemon daemon(createStarter, gJobs, policy);
+
+        if (daemon.open(gSocketPath)) {
+            gDaemon = &daemon;
+            signal(SIGTERM, stopDaemon);
+            signal(SIGINT, stopDaemon);
+            signal(SIGPIPE, SIG_IGN);
+
+            daemon.run();
+
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            gDaemon = nullptr;
+            success = true;
+        }
+    }
+
+    return finish(success ? EXIT_SUCCESS : EXIT_FAILURE);
+}
 
-    return (kill(pid, 0) == 0);
+static void stopSupervisor(int signal VARIABLE_IS_NOT_USED)
+{
+    if (gSupervisor != nullptr) {
+        gSupervisor->stop();
+    }
+}
+
+/**
+ * @brief Stay resident, re-activating the given plugins if they crash, until signalled to stop
+ *
+ * @return False if Thunder went away or a plugin was given up on
+ */
+static bool runSupervisor(const std::vector<string>& callsigns, const RetryPolicy& policy)
+{
+    bool success;
+
+    {
+        PluginSupervisor supervisor(callsigns, createStarter(), policy);
+
+        gSupervisor = &supervisor;
+        signal(SIGTERM, stopSupervisor);
+        signal(SIGINT, stopSupervisor);
+
+        success = supervisor.run();
+
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        gSupervisor = nullptr;
+    }
+
+    return success;
 }
 
 int main(int argc, char* argv[])
 {
     parseArgs(argc, argv);
 
-    initLogging(gLogLevel);
+    initLogging(gLogLevel, gLogTarget);
+
+    if (!gMetricsPath.empty() && !ActivationMetrics::instance().open(gMetricsPath)) {
+        return EXIT_FAILURE;
+    }
+
+    if (gExportMetrics) {
+        ActivationMetrics::instance().exportPrometheus(stdout);
+        return EXIT_SUCCESS;
+    }
+
+    // The client and board readers never talk to Thunder themselves, so skip all the Thunder setup
+    if (gMode == Mode::Client) {
+        return runClient();
+    }
+    if (gMode == Mode::Board) {
+        return runBoardQuery();
+    }
+
+    if (!gBoardPath.empty() && !StateBoard::instance().open(gBoardPath)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!gTracePath.empty() && !ActivationTrace::instance().open(gTracePath, gTraceFormat)) {
+        return EXIT_FAILURE;
+    }
+
+    // Computed wide and clamped, a large --delay would overflow
+    const uint32_t maxDelayMs = (gMaxRetryDelayMs != 0) ? gMaxRetryDelayMs : static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(gRetryDelayMs) * 16, UINT32_MAX));
+    RetryPolicy policy(gBackoff, gRetryCount, gRetryDelayMs, maxDelayMs, gDeadlineMs);
+
+    if (!gManifestPath.empty() && !loadManifest(policy)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!gHistoryPath.empty() && !ActivationHistory::instance().open(gHistoryPath)) {
+        return EXIT_FAILURE;
+    }
+
+    AdmissionControl::instance().configure(gAdmissionLimits);
+
+    LOG_DBG("Retry", "Using %s backoff, %u attempts, %u-%ums delay, %ums deadline", RetryPolicy::backoffName(policy.backoff()),
+        policy.maxAttempts(), policy.delayMs(), policy.maxDelayMs(), policy.deadlineMs());
+
+    // The daemon outlives Thunder restarts, its starters reconnect on the next request
+    if (gMode == Mode::Daemon) {
+        return runDaemon(policy);
+    }
+
+    // Thunder runs as WPEFramework on older releases
+    const std::vector<string> thunderProcesses = { "WPEFramework", "Thunder" };
+
+    bool thunderRunning;
+    {
+        ActivationTrace::Scope trace("discovery", string());
+
+        thunderRunning = (findProcess(thunderProcesses) != 0);
+        LOG_DBG("Discovery", "Thunder running=%d", thunderRunning);
+
+        if (!thunderRunning && gThunderTimeoutMs != 0) {
+            LOG_INF("Discovery", "Thunder is not running, waiting up to %dms for it to start", gThunderTimeoutMs);
+            thunderRunning = (waitForProcess(thunderProcesses, COMRPCStarter::communicatorPath(), gThunderTimeoutMs) != 0);
+        }
 
-    // Check if WPEFramework is running
-    uint32_t wpePid = getPID("WPEFramework");
-    bool isWpeRunning = isRunning(wpePid);
-    fprintf(stderr, "[INFO] WPEFramework running=%d\n", isWpeRunning);
+        trace.result(thunderRunning ? Core::ERROR_NONE : Core::ERROR_UNAVAILABLE);
+    }
 
-    bool isThunderRunning = false;
-    // Only check Thunder if WPEFramework is not running
-    if (!isWpeRunning) {
-        uint32_t thunderPid = getPID("Thunder");
-        isThunderRunning = isRunning(thunderPid);
-        fprintf(stderr, "[INFO] Thunder running=%d\n", isThunderRunning);
+    if (!thunderRunning) {
+        ActivationTrace::instance().flush();
 
-        if (!isThunderRunning) {
+        if (gThunderTimeoutMs == 0) {
             fprintf(stderr, "Thunder is not running.\n");
-            return 0;
+
+            // Nothing can be confirmed about (or saved from) the plugins of a Thunder that isn't there
+            return (gMode == Mode::Wait || gMode == Mode::Snapshot) ? EXIT_FAILURE : 0;
         }
+
+        LOG_ERROR("Discovery", "Thunder did not start within %dms", gThunderTimeoutMs);
+        return EXIT_FAILURE;
     }
 
-    // For now, we only implement the starter in COM-RPC but could do a JSON-RPC version
-    // in the future
-    bool success;
+    if (gMode == Mode::Wait) {
+        bool success;
+        {
+            StateWaiter waiter;
+            success = waiter.wait(gCallsigns, gWaitState, gDeadlineMs);
+        }
+
+        if (success) {
+            LOG_INF("Wait", "%zu plugin(s) %s", gCallsigns.size(), StateWaiter::stateName(gWaitState));
+        }
+
+        ActivationTrace::instance().flush();
+        return finish(success ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if (gMode == Mode::Snapshot) {
+        std::vector<string> activated;
+        const bool success = PluginSnapshot::capture(activated) && PluginSnapshot::save(gSnapshotPath, activated);
+
+        if (success) {
+            LOG_INF("Snapshot", "Saved %zu activated plugin(s) to %s", activated.size(), gSnapshotPath.c_str());
+        }
+
+        return finish(success ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    std::vector<string> succeeded;
+    std::vector<string> failed;
+    std::vector<string> timedOut;
 
     {
-        auto starter = std::unique_ptr<IPluginStarter>(new COMRPCStarter(gPluginName));
-        // Explicitly check for deactivate or activate
-        if (gDeactivate) {
-            success = starter->deactivatePlugin(gRetryCount, gRetryDelayMs);
-        } else {
-            success = starter->activatePlugin(gRetryCount, gRetryDelayMs);
+        // Each worker gets its own starter, so with a single job everything goes over one connection.
+        // Deactivation and hibernation run the dependencies in reverse, tearing down independent branches in parallel
+        ActivationEngine engine(createStarter, gJobs, gOperation);
+
+        for (const string& callsign : gCallsigns) {
+            engine.addPlugin(callsign, pluginOptions(callsign, policy));
+        }
+        for (const auto& dependency : gDependencies) {
+            engine.addDependency(dependency.first, dependency.second);
+        }
+
+        engine.run(policy, gRunDeadlineMs);
+
+        for (const ActivationEngine::Result& result : engine.results()) {
+            if (result.outcome == ActivationEngine::Outcome::TimedOut) {
+                timedOut.push_back(result.callsign);
+            } else if (result.outcome != ActivationEngine::Outcome::Succeeded) {
+                failed.push_back(result.callsign);
+            } else {
+                succeeded.push_back(result.callsign);
+            }
         }
     }
 
-    Core::Singleton::Dispose();
-    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (gCallsigns.size() > 1) {
+        LOG_INF("Summary", "%zu/%zu plugin(s) %sd successfully", succeeded.size(), gCallsigns.size(), IPluginStarter::operationName(gOperation));
+        for (const string& callsign : failed) {
+            LOG_ERROR("Summary", "Failed to %s %s", IPluginStarter::operationName(gOperation), callsign.c_str());
+        }
+    }
+    for (const string& callsign : timedOut) {
+        LOG_ERROR("Summary", "Did not get to %s %s within the %dms run deadline", IPluginStarter::operationName(gOperation), callsign.c_str(), gRunDeadlineMs);
+    }
+
+    ActivationTrace::instance().flush();
+    ActivationHistory::instance().save();
+
+    // Only the plugins that came up are supervised, the rest have already been given up on
+    bool supervised = true;
+    if (gSupervise && !succeeded.empty()) {
+        supervised = runSupervisor(succeeded, policy);
+        ActivationTrace::instance().flush();
+    }
+
+    return finish((failed.empty() && timedOut.empty() && supervised) ? EXIT_SUCCESS : EXIT_FAILURE);
 }
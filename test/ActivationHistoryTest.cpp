@@ -0,0 +1,183 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ActivationHistory.h"
+#include "TemporaryDirectory.h"
+
+#include <catch2/catch.hpp>
+
+#include <fstream>
+
+static ActivationHistory::Estimate makeEstimate(const uint32_t totalP50Ms, const uint32_t totalP95Ms)
+{
+    ActivationHistory::Estimate estimate;
+    estimate.samples = 16;
+    estimate.activationP50Ms = totalP50Ms;
+    estimate.activationP95Ms = totalP95Ms;
+    estimate.totalP50Ms = totalP50Ms;
+    estimate.totalP95Ms = totalP95Ms;
+    return estimate;
+}
+
+TEST_CASE("Slow plugins are retried less often", "[ActivationHistory]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 10, 100, 2000, 0);
+
+    CHECK(ActivationHistory::adapt(policy, makeEstimate(4000, 4000)).delayMs() == 1000);
+    CHECK(ActivationHistory::adapt(policy, makeEstimate(40000, 40000)).delayMs() == 2000);
+}
+
+TEST_CASE("The delay is never made shorter", "[ActivationHistory]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 10, 100, 2000, 0);
+
+    CHECK(ActivationHistory::adapt(policy, makeEstimate(40, 80)).delayMs() == 100);
+}
+
+TEST_CASE("A fitted deadline only stops retrying", "[ActivationHistory]")
+{
+    RetryPolicy policy(RetryPolicy::Backoff::Exponential, 10, 100, 2000, 0);
+    policy.callTimeoutMs(700);
+
+    const RetryPolicy adapted = ActivationHistory::adapt(policy, makeEstimate(1000, 3000));
+
+    CHECK(adapted.deadlineMs() == 12000);
+    CHECK(adapted.callDeadlineMs() == 0);
+    CHECK(adapted.backoff() == RetryPolicy::Backoff::Exponential);
+    CHECK(adapted.maxAttempts() == 10);
+    CHECK(adapted.maxDelayMs() == 2000);
+    CHECK(adapted.callTimeoutMs() == 700);
+}
+
+TEST_CASE("A fitted deadline is never too short", "[ActivationHistory]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 10, 100, 2000, 0);
+
+    CHECK(ActivationHistory::adapt(policy, makeEstimate(10, 20)).deadlineMs() == 5000);
+}
+
+TEST_CASE("A fitted deadline keeps a separate call deadline", "[ActivationHistory]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 10, 100, 2000, 0, 30000);
+
+    const RetryPolicy adapted = ActivationHistory::adapt(policy, makeEstimate(1000, 3000));
+
+    CHECK(adapted.deadlineMs() == 12000);
+    CHECK(adapted.callDeadlineMs() == 30000);
+}
+
+TEST_CASE("An explicit deadline is kept", "[ActivationHistory]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 10, 100, 2000, 8000);
+
+    const RetryPolicy adapted = ActivationHistory::adapt(policy, makeEstimate(1000, 30000));
+
+    CHECK(adapted.deadlineMs() == 8000);
+    CHECK(adapted.callDeadlineMs() == 8000);
+}
+
+TEST_CASE("Estimates need a few samples", "[ActivationHistory]")
+{
+    TemporaryDirectory directory;
+    ActivationHistory& history = ActivationHistory::instance();
+    REQUIRE(history.open(directory.file("history")));
+
+    ActivationHistory::Estimate estimate;
+
+    history.record("Few", 100, 200);
+    history.record("Few", 100, 200);
+    CHECK_FALSE(history.estimate("Few", estimate));
+
+    history.record("Few", 100, 200);
+    REQUIRE(history.estimate("Few", estimate));
+    CHECK(estimate.samples == 3);
+}
+
+TEST_CASE("Estimates are percentiles of the recent samples", "[ActivationHistory]")
+{
+    TemporaryDirectory directory;
+    ActivationHistory& history = ActivationHistory::instance();
+    REQUIRE(history.open(directory.file("history")));
+
+    // Only the most recent samples count, the slow early ones fall out of the window
+    for (uint32_t i = 0; i < 4; i++) {
+        history.record("Window", 60000, 60000);
+    }
+    for (uint32_t i = 1; i <= 16; i++) {
+        history.record("Window", i * 10, i * 100);
+    }
+
+    ActivationHistory::Estimate estimate;
+    REQUIRE(history.estimate("Window", estimate));
+
+    CHECK(estimate.samples == 16);
+    CHECK(estimate.activationP50Ms == 90);
+    CHECK(estimate.activationP95Ms == 160);
+    CHECK(estimate.totalP50Ms == 900);
+    CHECK(estimate.totalP95Ms == 1600);
+}
+
+TEST_CASE("The history survives a restart", "[ActivationHistory]")
+{
+    TemporaryDirectory directory;
+    const std::string path = directory.file("history");
+    ActivationHistory& history = ActivationHistory::instance();
+
+    REQUIRE(history.open(path));
+    history.record("Saved", 100, 400);
+    history.record("Saved", 200, 500);
+    history.record("Saved", 300, 600);
+    history.save();
+
+    // Another activator saved in the meantime
+    {
+        std::ofstream file(path, std::ios::app);
+        file << "Other 10,20 10,20 10,20\n";
+    }
+
+    REQUIRE(history.open(path));
+
+    ActivationHistory::Estimate estimate;
+    REQUIRE(history.estimate("Saved", estimate));
+    CHECK(estimate.samples == 3);
+    CHECK(estimate.activationP50Ms == 200);
+    CHECK(estimate.totalP95Ms == 600);
+
+    REQUIRE(history.estimate("Other", estimate));
+    CHECK(estimate.totalP50Ms == 20);
+}
+
+TEST_CASE("Malformed samples are skipped", "[ActivationHistory]")
+{
+    TemporaryDirectory directory;
+    const std::string path = directory.file("history");
+
+    {
+        std::ofstream file(path);
+        file << "# PluginActivator activation history v1\n\nMixed 10,20 oops 30;40 50,60 70,80\n";
+    }
+
+    ActivationHistory& history = ActivationHistory::instance();
+    REQUIRE(history.open(path));
+
+    ActivationHistory::Estimate estimate;
+    REQUIRE(history.estimate("Mixed", estimate));
+    CHECK(estimate.samples == 3);
+    CHECK(estimate.totalP50Ms == 60);
+}
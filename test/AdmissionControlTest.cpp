@@ -0,0 +1,53 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AdmissionControl.h"
+
+#include <catch2/catch.hpp>
+
+TEST_CASE("Admission limits are parsed", "[AdmissionControl]")
+{
+    AdmissionControl::Limits limits;
+
+    REQUIRE(AdmissionControl::parseLimits("available=64,memory=10.5,cpu=80,io=25", limits));
+    CHECK(limits.minAvailableKb == 64 * 1024);
+    CHECK(limits.maxMemoryPressure == Approx(10.5));
+    CHECK(limits.maxCpuPressure == Approx(80));
+    CHECK(limits.maxIoPressure == Approx(25));
+}
+
+TEST_CASE("Admission limits not given are left alone", "[AdmissionControl]")
+{
+    AdmissionControl::Limits limits;
+    limits.maxCpuPressure = 50;
+
+    REQUIRE(AdmissionControl::parseLimits("available=0.5", limits));
+    CHECK(limits.minAvailableKb == 512);
+    CHECK(limits.maxMemoryPressure == 0);
+    CHECK(limits.maxCpuPressure == Approx(50));
+    CHECK(limits.maxIoPressure == 0);
+}
+
+TEST_CASE("Invalid admission limits are rejected", "[AdmissionControl]")
+{
+    const char* invalid = GENERATE("memory", "memory=", "memory=high", "memory=10%", "memory=-1", "disk=10", "=10", "cpu=10,,io=5");
+
+    AdmissionControl::Limits limits;
+    CHECK_FALSE(AdmissionControl::parseLimits(invalid, limits));
+}
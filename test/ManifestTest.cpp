@@ -0,0 +1,172 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Manifest.h"
+#include "TemporaryDirectory.h"
+
+#include <catch2/catch.hpp>
+
+#include <fstream>
+
+/**
+ * @brief Write a manifest and load it on top of the default policy
+ */
+static bool loadManifest(Manifest& manifest, const std::string& content, const uint32_t explicitSettings = 0, const RetryPolicy& defaultPolicy = RetryPolicy())
+{
+    TemporaryDirectory directory;
+    const std::string path = directory.file("manifest.json");
+
+    {
+        std::ofstream file(path);
+        file << content;
+    }
+
+    return manifest.load(path, defaultPolicy, explicitSettings);
+}
+
+TEST_CASE("A manifest lists the plugins in order", "[Manifest]")
+{
+    Manifest manifest;
+
+    REQUIRE(loadManifest(manifest, R"({
+        "jobs": 4,
+        "plugins": [
+            { "callsign": "Network", "priority": 10, "cost": 300 },
+            { "callsign": "OCDM", "depends": [ "Network", "Storage" ] }
+        ]
+    })"));
+
+    CHECK(manifest.jobs() == 4);
+    REQUIRE(manifest.plugins().size() == 2);
+
+    const Manifest::Plugin& network = manifest.plugins()[0];
+    CHECK(network.callsign == "Network");
+    CHECK(network.priority == 10);
+    CHECK(network.costMs == 300);
+    CHECK(network.depends.empty());
+    CHECK_FALSE(network.hasPolicy);
+
+    const Manifest::Plugin& ocdm = manifest.plugins()[1];
+    CHECK(ocdm.callsign == "OCDM");
+    CHECK(ocdm.depends == std::vector<std::string>({ "Network", "Storage" }));
+}
+
+TEST_CASE("The manifest's retry settings replace the defaults", "[Manifest]")
+{
+    Manifest manifest;
+
+    REQUIRE(loadManifest(manifest, R"({
+        "retry": { "backoff": "jitter", "attempts": 20, "delay": 100, "maxdelay": 2000, "deadline": 30000, "calltimeout": 5000 },
+        "plugins": [ { "callsign": "Network" } ]
+    })"));
+
+    const RetryPolicy& policy = manifest.policy();
+    CHECK(policy.backoff() == RetryPolicy::Backoff::Jitter);
+    CHECK(policy.maxAttempts() == 20);
+    CHECK(policy.delayMs() == 100);
+    CHECK(policy.maxDelayMs() == 2000);
+    CHECK(policy.deadlineMs() == 30000);
+    CHECK(policy.callDeadlineMs() == 30000);
+    CHECK(policy.callTimeoutMs() == 5000);
+}
+
+TEST_CASE("Explicit command line options win over the manifest", "[Manifest]")
+{
+    RetryPolicy defaultPolicy(RetryPolicy::Backoff::Exponential, 7, 50, 800, 9000);
+    defaultPolicy.callTimeoutMs(1000);
+
+    Manifest manifest;
+
+    REQUIRE(loadManifest(manifest, R"({
+        "retry": { "backoff": "fixed", "attempts": 20, "delay": 100, "maxdelay": 2000, "deadline": 30000, "calltimeout": 5000 },
+        "plugins": [ { "callsign": "Network" } ]
+    })",
+        Manifest::RetryAttempts | Manifest::RetryDeadline | Manifest::RetryCallTimeout, defaultPolicy));
+
+    const RetryPolicy& policy = manifest.policy();
+    CHECK(policy.backoff() == RetryPolicy::Backoff::Fixed);
+    CHECK(policy.maxAttempts() == 7);
+    CHECK(policy.delayMs() == 100);
+    CHECK(policy.maxDelayMs() == 2000);
+    CHECK(policy.deadlineMs() == 9000);
+    CHECK(policy.callDeadlineMs() == 9000);
+    CHECK(policy.callTimeoutMs() == 1000);
+}
+
+TEST_CASE("A plugin's retry settings override single fields", "[Manifest]")
+{
+    Manifest manifest;
+
+    REQUIRE(loadManifest(manifest, R"({
+        "retry": { "backoff": "jitter", "attempts": 20, "delay": 100, "deadline": 30000 },
+        "plugins": [
+            { "callsign": "Network" },
+            { "callsign": "OCDM", "retry": { "attempts": 5, "calltimeout": 2500 } }
+        ]
+    })",
+        Manifest::RetryAttempts));
+
+    REQUIRE(manifest.plugins().size() == 2);
+    CHECK_FALSE(manifest.plugins()[0].hasPolicy);
+
+    const Manifest::Plugin& ocdm = manifest.plugins()[1];
+    REQUIRE(ocdm.hasPolicy);
+    CHECK(ocdm.policy.backoff() == RetryPolicy::Backoff::Jitter);
+    CHECK(ocdm.policy.maxAttempts() == 5);
+    CHECK(ocdm.policy.delayMs() == 100);
+    CHECK(ocdm.policy.deadlineMs() == 30000);
+    CHECK(ocdm.policy.callTimeoutMs() == 2500);
+
+    // The plugin's own settings don't leak into the manifest's
+    CHECK(manifest.policy().maxAttempts() == RetryPolicy().maxAttempts());
+    CHECK(manifest.policy().callTimeoutMs() == 0);
+}
+
+TEST_CASE("Invalid manifests are rejected", "[Manifest]")
+{
+    const char* invalid = GENERATE(
+        R"({ "jobs": 256, "plugins": [ { "callsign": "Network" } ] })",
+        R"({ "retry": { "attempts": 0 }, "plugins": [ { "callsign": "Network" } ] })",
+        R"({ "plugins": [ { "callsign": "Network", "retry": { "attempts": 0 } } ] })",
+        R"({ "retry": { "backoff": "linear" }, "plugins": [ { "callsign": "Network" } ] })",
+        R"({ "plugins": [ { "callsign": "Network" }, { "priority": 1 } ] })",
+        R"({ "plugins": [ { "callsign": "Network" } )");
+
+    Manifest manifest;
+    CHECK_FALSE(loadManifest(manifest, invalid));
+}
+
+TEST_CASE("Unlimited attempts are fine with a deadline", "[Manifest]")
+{
+    Manifest manifest;
+
+    REQUIRE(loadManifest(manifest, R"({
+        "retry": { "attempts": 0, "deadline": 10000 },
+        "plugins": [ { "callsign": "Network" } ]
+    })"));
+
+    CHECK(manifest.policy().maxAttempts() == 0);
+    CHECK(manifest.policy().deadlineMs() == 10000);
+}
+
+TEST_CASE("A missing manifest is an error", "[Manifest]")
+{
+    Manifest manifest;
+    CHECK_FALSE(manifest.load("/nonexistent/manifest.json", RetryPolicy(), 0));
+}
@@ -0,0 +1,241 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RetryPolicy.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Number of attempts a schedule allows when every retry is tried straight away
+ */
+static uint32_t countAttempts(RetryPolicy::Schedule& schedule, const bool refund)
+{
+    uint32_t attempts = 1;
+    uint32_t delayMs = 0;
+
+    while (schedule.next(delayMs)) {
+        if (refund) {
+            schedule.refund();
+        }
+        attempts++;
+    }
+
+    return attempts;
+}
+
+TEST_CASE("A policy never waits less than its base delay", "[RetryPolicy]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 5, 300, 100, 0);
+
+    CHECK(policy.delayMs() == 300);
+    CHECK(policy.maxDelayMs() == 300);
+}
+
+TEST_CASE("The default policy has a limit on attempts", "[RetryPolicy]")
+{
+    const RetryPolicy policy;
+
+    CHECK(policy.backoff() == RetryPolicy::Backoff::Fixed);
+    CHECK(policy.maxAttempts() == 100);
+    CHECK(policy.deadlineMs() == 0);
+    CHECK(policy.callDeadlineMs() == 0);
+    CHECK(policy.callTimeoutMs() == 0);
+}
+
+TEST_CASE("Backoff names round trip", "[RetryPolicy]")
+{
+    for (const RetryPolicy::Backoff backoff : { RetryPolicy::Backoff::Fixed, RetryPolicy::Backoff::Exponential, RetryPolicy::Backoff::Jitter }) {
+        RetryPolicy::Backoff parsed = RetryPolicy::Backoff::Fixed;
+        CHECK(RetryPolicy::parseBackoff(RetryPolicy::backoffName(backoff), parsed));
+        CHECK(parsed == backoff);
+    }
+
+    RetryPolicy::Backoff parsed = RetryPolicy::Backoff::Exponential;
+    CHECK_FALSE(RetryPolicy::parseBackoff("linear", parsed));
+    CHECK(parsed == RetryPolicy::Backoff::Exponential);
+}
+
+TEST_CASE("A schedule stops after the maximum number of attempts", "[RetryPolicy]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 3, 10, 10, 0);
+    RetryPolicy::Schedule schedule(policy);
+
+    uint32_t delayMs = 0;
+
+    CHECK(schedule.attempt() == 1);
+    REQUIRE(schedule.next(delayMs));
+    CHECK(delayMs == 10);
+    CHECK(schedule.attempt() == 2);
+    REQUIRE(schedule.next(delayMs));
+    CHECK(schedule.attempt() == 3);
+    CHECK(schedule.counted() == 3);
+    CHECK_FALSE(schedule.next(delayMs));
+    CHECK(schedule.attempt() == 3);
+}
+
+TEST_CASE("Refunded attempts are capped at the maximum number of attempts", "[RetryPolicy]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 3, 10, 10, 0);
+
+    SECTION("Without refunds")
+    {
+        RetryPolicy::Schedule schedule(policy);
+        CHECK(countAttempts(schedule, false) == 3);
+    }
+
+    SECTION("Every retry refunded")
+    {
+        RetryPolicy::Schedule schedule(policy);
+        CHECK(countAttempts(schedule, true) == 6);
+    }
+}
+
+TEST_CASE("The first attempt is never refunded", "[RetryPolicy]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 3, 10, 10, 0);
+    RetryPolicy::Schedule schedule(policy);
+
+    schedule.refund();
+    CHECK(schedule.counted() == 1);
+    CHECK(countAttempts(schedule, false) == 3);
+}
+
+TEST_CASE("Exponential backoff doubles up to the maximum delay", "[RetryPolicy]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Exponential, 10, 100, 1000, 0);
+    RetryPolicy::Schedule schedule(policy);
+
+    std::vector<uint32_t> delays;
+    uint32_t delayMs = 0;
+    while (schedule.next(delayMs)) {
+        delays.push_back(delayMs);
+    }
+
+    CHECK(delays == std::vector<uint32_t>({ 100, 200, 400, 800, 1000, 1000, 1000, 1000, 1000 }));
+}
+
+TEST_CASE("Jitter stays between the base delay and three times the previous one", "[RetryPolicy]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Jitter, 0, 100, 5000, 60000);
+    RetryPolicy::Schedule schedule(policy);
+
+    uint32_t previousMs = policy.delayMs();
+    uint32_t delayMs = 0;
+
+    for (int i = 0; i < 1000; i++) {
+        REQUIRE(schedule.next(delayMs));
+        CHECK(delayMs >= policy.delayMs());
+        CHECK(delayMs <= std::min(previousMs * 3, policy.maxDelayMs()));
+        previousMs = delayMs;
+    }
+}
+
+TEST_CASE("The deadline stops retries and shortens the last delay", "[RetryPolicy]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 0, 1000, 1000, 50);
+    RetryPolicy::Schedule schedule(policy);
+
+    uint32_t delayMs = 0;
+
+    CHECK_FALSE(schedule.expired());
+    REQUIRE(schedule.next(delayMs));
+    CHECK(delayMs <= 50);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+
+    CHECK(schedule.expired());
+    CHECK(schedule.remainingMs() == 0);
+    CHECK_FALSE(schedule.next(delayMs));
+}
+
+TEST_CASE("Without a deadline nothing expires", "[RetryPolicy]")
+{
+    const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 3, 10, 10, 0);
+    RetryPolicy::Schedule schedule(policy);
+
+    CHECK(schedule.remainingMs() == UINT32_MAX);
+    CHECK_FALSE(schedule.expired());
+}
+
+TEST_CASE("Call timeouts", "[RetryPolicy]")
+{
+    SECTION("The starter's timeout applies without a deadline")
+    {
+        const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 3, 10, 10, 0);
+        RetryPolicy::Schedule schedule(policy);
+
+        CHECK(schedule.callTimeoutMs(3000) == 3000);
+        CHECK(schedule.callTimeoutMs(0) == 0);
+    }
+
+    SECTION("The policy's own call timeout wins over the starter's")
+    {
+        RetryPolicy policy(RetryPolicy::Backoff::Fixed, 3, 10, 10, 0);
+        policy.callTimeoutMs(1500);
+        RetryPolicy::Schedule schedule(policy);
+
+        CHECK(schedule.callTimeoutMs(3000) == 1500);
+        CHECK(schedule.callTimeoutMs(0) == 1500);
+    }
+
+    SECTION("The deadline cuts a call short")
+    {
+        const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 3, 10, 10, 1000);
+        RetryPolicy::Schedule schedule(policy);
+
+        CHECK(policy.callDeadlineMs() == 1000);
+        CHECK(schedule.callTimeoutMs(60000) <= 1000);
+        CHECK(schedule.callTimeoutMs(0) <= 1000);
+        CHECK(schedule.callTimeoutMs(0) > 0);
+        CHECK(schedule.callTimeoutMs(100) == 100);
+    }
+
+    SECTION("A deadline that only stops retrying doesn't cut calls short")
+    {
+        const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 3, 10, 10, 1000, 0);
+        RetryPolicy::Schedule schedule(policy);
+
+        CHECK(schedule.remainingMs() <= 1000);
+        CHECK(schedule.callTimeoutMs(60000) == 60000);
+        CHECK(schedule.callTimeoutMs(0) == 0);
+    }
+
+    SECTION("A call deadline later than the retry deadline bounds calls by itself")
+    {
+        const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 3, 10, 10, 1000, 20000);
+        RetryPolicy::Schedule schedule(policy);
+
+        CHECK(schedule.remainingMs() <= 1000);
+        CHECK(schedule.callTimeoutMs(60000) > 1000);
+        CHECK(schedule.callTimeoutMs(60000) <= 20000);
+    }
+
+    SECTION("A passed call deadline still leaves a minimal call")
+    {
+        const RetryPolicy policy(RetryPolicy::Backoff::Fixed, 3, 10, 10, 10);
+        RetryPolicy::Schedule schedule(policy);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CHECK(schedule.callTimeoutMs(60000) == 1);
+    }
+}
@@ -0,0 +1,180 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SharedTable.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <functional>
+#include <string.h>
+#include <sys/wait.h>
+#include <thread>
+
+namespace {
+
+struct Slot {
+    std::atomic<uint32_t> state;
+    char name[16];
+};
+
+static constexpr size_t kSlots = 4;
+
+class Table {
+public:
+    Table()
+        : _slots()
+    {
+        for (Slot& slot : _slots) {
+            slot.state.store(Free);
+            memset(slot.name, 0, sizeof(slot.name));
+        }
+    }
+
+    int32_t claim(const char* name, const size_t hash) { return claimSlot(_slots, kSlots, hash, matcher(name), filler(name)); }
+    int32_t find(const char* name, const size_t hash) const { return findSlot(_slots, kSlots, hash, matcher(name)); }
+
+    Slot& operator[](const size_t index) { return _slots[index]; }
+
+    static std::function<bool(const Slot&)> matcher(const char* name)
+    {
+        return [name](const Slot& slot) { return strcmp(slot.name, name) == 0; };
+    }
+
+    static std::function<void(Slot&)> filler(const char* name)
+    {
+        return [name](Slot& slot) { strncpy(slot.name, name, sizeof(slot.name) - 1); };
+    }
+
+private:
+    Slot _slots[kSlots];
+};
+
+/**
+ * @brief PID of a process that has exited and been reaped
+ */
+pid_t deadProcess()
+{
+    const pid_t pid = fork();
+    if (pid == 0) {
+        _exit(0);
+    }
+
+    waitpid(pid, nullptr, 0);
+    return pid;
+}
+
+}
+
+TEST_CASE("A key keeps the slot it claimed", "[SharedTable]")
+{
+    Table table;
+
+    CHECK(table.claim("Network", 1) == 1);
+    CHECK(slotState(table[1].state.load()) == Used);
+    CHECK(std::string(table[1].name) == "Network");
+
+    CHECK(table.claim("Network", 1) == 1);
+    CHECK(table.find("Network", 1) == 1);
+}
+
+TEST_CASE("Colliding keys probe on to the next free slot", "[SharedTable]")
+{
+    Table table;
+
+    CHECK(table.claim("A", 3) == 3);
+    CHECK(table.claim("B", 3) == 0);
+    CHECK(table.claim("C", 3) == 1);
+
+    CHECK(table.find("B", 3) == 0);
+    CHECK(table.find("C", 3) == 1);
+    CHECK(table.find("D", 3) == -1);
+}
+
+TEST_CASE("A full table has no slot for another key", "[SharedTable]")
+{
+    Table table;
+    const char* names[] = { "A", "B", "C", "D" };
+
+    for (const char* name : names) {
+        REQUIRE(table.claim(name, 0) >= 0);
+    }
+
+    CHECK(table.claim("E", 0) == -1);
+    CHECK(table.find("E", 0) == -1);
+    CHECK(table.claim("D", 0) == 3);
+}
+
+TEST_CASE("A slot being claimed is not found yet", "[SharedTable]")
+{
+    Table table;
+
+    table[2].state.store(slotWord(Claiming, getpid()));
+    strcpy(table[2].name, "Pending");
+
+    CHECK(table.find("Pending", 2) == -1);
+}
+
+TEST_CASE("A live claimer is waited for", "[SharedTable]")
+{
+    Table table;
+
+    table[2].state.store(slotWord(Claiming, getpid()));
+
+    std::thread claimer([&table]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        strcpy(table[2].name, "Slow");
+        table[2].state.store(Used, std::memory_order_release);
+    });
+
+    CHECK(table.claim("Slow", 2) == 2);
+    CHECK(slotState(table[2].state.load()) == Used);
+
+    claimer.join();
+}
+
+TEST_CASE("A slot left by a claimer that died is taken over", "[SharedTable]")
+{
+    const SlotState state = GENERATE(Claiming, Recovering);
+
+    Table table;
+    const pid_t dead = deadProcess();
+    REQUIRE(ownerDied(dead));
+
+    table[1].state.store(slotWord(state, dead));
+
+    CHECK(table.claim("Orphan", 1) == 1);
+    CHECK(table[1].state.load() == Used);
+    CHECK(std::string(table[1].name) == "Orphan");
+    CHECK(table.find("Orphan", 1) == 1);
+}
+
+TEST_CASE("Only a process that is gone counts as dead", "[SharedTable]")
+{
+    CHECK_FALSE(ownerDied(getpid()));
+    CHECK_FALSE(ownerDied(0));
+}
+
+TEST_CASE("Names hash the same in every build", "[SharedTable]")
+{
+    CHECK(hashName("") == 2166136261u);
+    CHECK(hashName("a") == 0xe40c292cu);
+    CHECK(hashName("Network") == hashName("Network"));
+    CHECK(hashName("Network") != hashName("network"));
+}
@@ -0,0 +1,69 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+/**
+ * @brief A directory for the files a test writes, removed with everything in it at the end of the test
+ */
+class TemporaryDirectory {
+public:
+    TemporaryDirectory()
+        : _path()
+    {
+        char path[] = "/tmp/PluginActivatorTest.XXXXXX";
+        if (mkdtemp(path) != nullptr) {
+            _path = path;
+        }
+    }
+
+    ~TemporaryDirectory()
+    {
+        if (_path.empty()) {
+            return;
+        }
+
+        DIR* directory = opendir(_path.c_str());
+        if (directory != nullptr) {
+            while (const struct dirent* entry = readdir(directory)) {
+                const std::string name = entry->d_name;
+                if (name != "." && name != "..") {
+                    unlink((_path + "/" + name).c_str());
+                }
+            }
+            closedir(directory);
+        }
+
+        rmdir(_path.c_str());
+    }
+
+    TemporaryDirectory(const TemporaryDirectory&) = delete;
+    TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+
+    const std::string& path() const { return _path; }
+    std::string file(const std::string& name) const { return _path + "/" + name; }
+
+private:
+    std::string _path;
+};